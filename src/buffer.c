@@ -66,6 +66,9 @@ static void backspace_output (void);
 /* PID of child program, if compress_option or remote archive access.  */
 static pid_t child_pid;
 
+/* True if the archive is read through a decompression program.  */
+static bool archive_decompressed;
+
 /* Error recovery stuff  */
 static int read_error_count;
 
@@ -74,6 +77,10 @@ static bool hit_eof;
 
 static bool read_full_records = false;
 
+/* True if file data may be copied to or from the archive directly,
+   without passing through the record buffer.  */
+static bool direct_copy_archive;
+
 /* We're reading, but we just read the last block and it's time to update.
    Declared in update.c
 
@@ -270,7 +277,8 @@ enum compress_type {
   ct_lzip,
   ct_lzma,
   ct_lzop,
-  ct_xz
+  ct_xz,
+  ct_zstd
 };
 
 static enum compress_type archive_compression_type = ct_none;
@@ -299,6 +307,7 @@ static struct zip_magic const magic[] = {
   { ct_lzma,     6, "\xFFLZMA" },
   { ct_lzop,     4, "\211LZO" },
   { ct_xz,       6, "\xFD" "7zXZ" },
+  { ct_zstd,     4, "\x28\xB5\x2F\xFD" },
 };
 
 #define NMAGIC (sizeof(magic)/sizeof(magic[0]))
@@ -314,6 +323,7 @@ static struct zip_program zip_program[] = {
   { ct_lzma,     XZ_PROGRAM,       "-J" },
   { ct_lzop,     LZOP_PROGRAM,     "--lzop" },
   { ct_xz,       XZ_PROGRAM,       "-J" },
+  { ct_zstd,     "zstd",           "-I zstd" },
   { ct_none }
 };
 
@@ -334,6 +344,25 @@ find_zip_program (enum compress_type type, int *pstate)
   return NULL;
 }
 
+/* Return true if PROGRAM, run as the compression program, may be
+   restarted for each frame of the archive, as --frame-size does.  The
+   frames are then separate compressed streams, one after another,
+   which only the decompressors of some formats read as a whole.  */
+bool
+compress_program_allows_frames (char const *program)
+{
+  static char const *const programs[] = {
+    GZIP_PROGRAM, BZIP2_PROGRAM, "lbzip2", XZ_PROGRAM, LZIP_PROGRAM, "zstd",
+    NULL
+  };
+  char const *const *p;
+
+  for (p = programs; *p; p++)
+    if (strcmp (program, *p) == 0)
+      return true;
+  return false;
+}
+
 const char *
 first_decompress_program (int *pstate)
 {
@@ -482,7 +511,8 @@ open_compressed_archive (void)
                           check_compressed_archive */
 
       /* Open compressed archive */
-      child_pid = sys_child_open_for_uncompress ();
+      child_pid = sys_child_open_for_uncompress (0);
+      archive_decompressed = true;
       read_full_records = true;
     }
 
@@ -651,6 +681,158 @@ available_space_after (union block *pointer)
   return record_end->buffer - pointer->buffer;
 }
 
+/* Largest number of bytes to copy directly in one go.  */
+#define DIRECT_COPY_MAX (1024 * 1024 * 1024)
+
+/* Copy up to SIZE bytes of the file open on FD, starting at its
+   current offset, directly to the archive, bypassing the record
+   buffer.  Only whole records are copied, and only if the record
+   buffer is empty and the archive is a plain local file.  Return the
+   number of bytes copied, which may be 0.  Any problem with the file
+   is left for the caller to diagnose when it reads the rest of the
+   file normally.  */
+off_t
+copy_file_to_archive (int fd, off_t size)
+{
+  off_t copied = 0;
+  off_t records;
+  size_t partial;
+
+  if (! direct_copy_archive || access_mode != ACCESS_WRITE
+      || size < record_size)
+    return 0;
+
+  if (current_block == record_end)
+    flush_archive ();
+  if (current_block != record_start)
+    return 0;
+
+  while (record_size - copied % record_size <= size - copied)
+    {
+      /* Stop at a record boundary.  If checkpoints are requested, stop
+	 at each record so that they run as often as usual.  */
+      size_t chunk = min (size - copied,
+			  checkpoint_option ? record_size : DIRECT_COPY_MAX);
+      ssize_t n;
+
+      chunk -= (copied + chunk) % record_size;
+      n = sys_copy_to_archive (fd, chunk);
+      if (n <= 0)
+	{
+	  if (n < 0)
+	    direct_copy_archive = false;
+	  break;
+	}
+      for (records = (copied + n) / record_size - copied / record_size;
+	   records; records--)
+	checkpoint_run (true);
+      copied += n;
+    }
+
+  /* Take back the bytes of an incomplete record: they will be written
+     again through the record buffer.  */
+  partial = copied % record_size;
+  if (partial)
+    {
+      if (lseek (archive, - (off_t) partial, SEEK_CUR) < 0)
+	FATAL_ERROR ((0, errno, _("%s: Cannot seek archive"),
+		      quotearg_colon (*archive_name_cursor)));
+      if (lseek (fd, - (off_t) partial, SEEK_CUR) < 0)
+	FATAL_ERROR ((0, errno, _("Cannot seek back in file being archived")));
+      copied -= partial;
+    }
+
+  records = copied / record_size;
+  records_written += records;
+  bytes_written += copied;
+  record_start_block += records * blocking_factor;
+  return copied;
+}
+
+/* Copy up to SIZE bytes of member data directly from the archive to
+   the file open on FD, bypassing the record buffer.  Only whole
+   records are copied, and only if the record buffer has been used up
+   and the archive is a local file or a pipe.  Return the number of
+   bytes of the archive used up, which may be 0.  If some of them
+   could not be written to FD, set *ERR to the error number, otherwise
+   set it to 0.  Read errors, and write errors at record boundaries,
+   are left for the caller to diagnose when it goes on normally.  */
+off_t
+copy_archive_to_file (int fd, off_t size, int *err)
+{
+  off_t copied = 0;
+  off_t records;
+  size_t partial;
+
+  *err = 0;
+  if (! direct_copy_archive || access_mode != ACCESS_READ
+      || write_archive_to_stdout || time_to_start_writing
+      || current_block != record_end || size < record_size)
+    return 0;
+
+  while (record_size - copied % record_size <= size - copied)
+    {
+      size_t chunk = min (size - copied,
+			  checkpoint_option ? record_size : DIRECT_COPY_MAX);
+      ssize_t n;
+
+      chunk -= (copied + chunk) % record_size;
+      n = sys_copy_from_archive (fd, chunk);
+      if (n <= 0)
+	{
+	  if (n < 0)
+	    {
+	      *err = errno;
+	      direct_copy_archive = false;
+	    }
+	  break;
+	}
+      for (records = (copied + n) / record_size - copied / record_size;
+	   records; records--)
+	checkpoint_run (false);
+      copied += n;
+    }
+
+  partial = copied % record_size;
+  if (partial)
+    {
+      /* Take back the incomplete record if possible, so that it is read
+	 again into the record buffer.  Otherwise read in and drop the
+	 rest of it, as its data could not be written anyway.  */
+      if (lseek (archive, - (off_t) partial, SEEK_CUR) >= 0)
+	{
+	  if (lseek (fd, - (off_t) partial, SEEK_CUR) < 0)
+	    FATAL_ERROR ((0, errno, _("Cannot seek back in extracted file")));
+	  copied -= partial;
+	  *err = 0;
+	}
+      else if (*err)
+	{
+	  size_t left = record_size - partial;
+	  while (left)
+	    {
+	      size_t status = safe_read (archive, record_start->buffer, left);
+	      if (status == SAFE_READ_ERROR)
+		archive_read_error ();
+	      else if (status == 0)
+		break;
+	      else
+		{
+		  left -= status;
+		  copied += status;
+		}
+	    }
+	}
+    }
+  else
+    *err = 0;
+
+  records = copied / record_size;
+  records_read += records;
+  record_start_block += records * blocking_factor;
+  return copied;
+}
+
 /* Close file having descriptor FD, and abort if close unsuccessful.  */
 void
 xclose (int fd)
@@ -710,6 +892,7 @@ _open_archive (enum access_mode wanted_access)
   check_tty (access_mode);
 
   read_full_records = read_full_records_option;
+  archive_decompressed = false;
 
   records_read = 0;
 
@@ -718,7 +901,8 @@ _open_archive (enum access_mode wanted_access)
       switch (wanted_access)
         {
         case ACCESS_READ:
-          child_pid = sys_child_open_for_uncompress ();
+          child_pid = sys_child_open_for_uncompress (0);
+          archive_decompressed = true;
           read_full_records = true;
           record_end = record_start; /* set up for 1st record = # 0 */
           break;
@@ -832,6 +1016,39 @@ _open_archive (enum access_mode wanted_access)
   sys_save_archive_dev_ino ();
   SET_BINARY_MODE (archive);
 
+  /* Hand the writing of the archive over to a separate process, unless
+     the archive needs to be seeked, reread or switched, or is already
+     written by a compressor.  */
+  if (wanted_access == ACCESS_WRITE && write_queue_option
+      && !use_compress_program_option && !multi_volume_option
+      && !verify_option && !dev_null_output && !_isrmt (archive))
+    child_pid = sys_child_open_for_write ();
+
+  /* File data can be copied straight into a plain local archive, and
+     out of any local archive.  */
+  if (wanted_access == ACCESS_READ)
+    direct_copy_archive = !multi_volume_option && !_isrmt (archive);
+  else
+    direct_copy_archive = (!child_pid && !use_compress_program_option
+			   && !multi_volume_option && !tape_length_option
+			   && !dev_null_output && !write_archive_to_stdout
+			   && sys_archive_is_regular ());
+
+  /* Hand the reading ahead of the archive over to a separate process,
+     unless it is decompressed by a child already.  The first record
+     has been read in by now.  */
+  if (wanted_access == ACCESS_READ && read_queue_option
+      && !use_compress_program_option && !multi_volume_option
+      && !_isrmt (archive))
+    {
+      child_pid = sys_child_open_for_read ();
+      if (child_pid)
+	{
+	  read_full_records = true;
+	  seekable_archive = false;
+	}
+    }
+
   switch (wanted_access)
     {
     case ACCESS_READ:
@@ -1099,6 +1316,75 @@ seek_archive (off_t size)
   return nblk;
 }
 
+/* Position the archive at the block with ordinal BLOCK.  Unless the
+   archive is seekable, BLOCK must not precede the current record, and
+   the records up to it are read in.  Return false if the archive is
+   too short.  */
+bool
+seek_archive_block (off_t block)
+{
+  off_t record = block / blocking_factor;
+
+  if (record_start_block <= block
+      && block < record_start_block + (record_end - record_start))
+    {
+      current_block = record_start + (block - record_start_block);
+      return true;
+    }
+
+  if (seekable_archive)
+    {
+      if (rmtlseek (archive, record * record_size, SEEK_SET) < 0)
+	{
+	  seek_diag_details (*archive_name_cursor, record * record_size);
+	  return false;
+	}
+
+      /* Have find_next_block read in the record.  */
+      record_start_block = (record * blocking_factor
+			    - (record_end - record_start));
+      hit_eof = false;
+    }
+  else if (block < record_start_block)
+    return false;
+
+  do
+    {
+      current_block = record_end;
+      if (! find_next_block ())
+	return false;
+    }
+  while (record_start_block + (record_end - record_start) <= block);
+
+  current_block = record_start + (block - record_start_block);
+  return true;
+}
+
+/* Return true if the archive is decompressed from a local file, so
+   that decompression can be restarted anywhere in it.  */
+bool
+compressed_archive_seekable (void)
+{
+  return archive_decompressed && sys_archive_file_is_regular ();
+}
+
+/* Restart decompressing the archive at OFFSET in the compressed file.
+   The compressed data there must start a new compressed stream, which
+   holds the archive from the block with ordinal BLOCK on.  */
+void
+restart_decompression (off_t offset, off_t block)
+{
+  if (rmtclose (archive) != 0)
+    close_error (*archive_name_cursor);
+  sys_kill_child (child_pid);
+  child_pid = sys_child_open_for_uncompress (offset);
+
+  /* Have find_next_block read in the record at BLOCK.  */
+  record_start_block = block - (record_end - record_start);
+  current_block = record_end;
+  hit_eof = false;
+}
+
 /* Close the archive file.  */
 void
 close_archive (void)
@@ -1674,6 +1960,7 @@ _write_volume_label (const char *str)
     xheader_store ("GNU.volume.label", &dummy, str);
   else
     {
+      off_t block_ordinal = current_block_ordinal ();
       union block *label = find_next_block ();
 
       memset (label, 0, BLOCKSIZE);
@@ -1688,6 +1975,8 @@ _write_volume_label (const char *str)
       TIME_TO_CHARS (start_time.tv_sec, label->header.mtime);
       finish_header (&current_stat_info, label, -1);
       set_next_block_after (label);
+      index_add_header (GNUTYPE_VOLHDR, current_stat_info.file_name,
+			block_ordinal);
     }
 }
 
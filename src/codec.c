@@ -0,0 +1,929 @@
+/* Compression and decompression with libraries for GNU tar.
+
+   Copyright 2016 Free Software Foundation, Inc.
+
+   This file is part of GNU tar.
+
+   GNU tar is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU tar is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* When tar is built with zlib, liblzma or libzstd, the gzip, xz and
+   zstd formats are compressed and decompressed by calling the library,
+   rather than by running the program of the same name and piping the
+   archive through it.  */
+
+#include <system.h>
+#include "common.h"
+
+#if HAVE_ZLIB
+# include <zlib.h>
+#endif
+#if HAVE_LIBLZMA
+# include <lzma.h>
+#endif
+#if HAVE_LIBZSTD
+# include <zstd.h>
+#endif
+
+/* Size of the buffer that compressed data are collected in.  */
+enum { CODEC_BUFFER_SIZE = 64 * 1024 };
+
+/* Maximum number of bytes handed to a library at a time.  */
+enum { CODEC_INPUT_MAX = 1 << 30 };
+
+/* Maximum size of the header of an xz block.  */
+enum { XZ_BLOCK_HEADER_MAX = 1024 };
+
+struct codec
+{
+  enum codec_format format;	/* Format of the compressed data */
+  bool compress;		/* True if compressing */
+  char const *program;		/* Program the library stands in for */
+  char *buffer;			/* CODEC_BUFFER_SIZE bytes of output */
+
+  /* When decompressing: */
+  bool ended;			/* True at the end of a stream */
+  bool padding;			/* True if only zeros may follow */
+#if HAVE_ZLIB
+  z_stream gzip;
+#endif
+#if HAVE_LIBLZMA
+  lzma_stream xz;
+  int xz_block_check;		/* Check of the xz blocks, or -1 */
+  lzma_block xz_block;		/* Block being decoded, which the decoder
+				   refers to until its end */
+  size_t xz_header_size;	/* Size of the block header, or 0 */
+  size_t xz_header_read;	/* Number of its bytes read so far */
+  uint8_t xz_header[XZ_BLOCK_HEADER_MAX];
+#endif
+#if HAVE_LIBZSTD
+  ZSTD_CCtx *zstd;
+  ZSTD_DCtx *unzstd;
+#endif
+};
+
+/* Return the format that the library compresses into instead of
+   PROGRAM, or codec_none if PROGRAM is to be run.  Only the programs
+   selected by the compression options are replaced: any other command,
+   for instance one with options of its own, is run as given.  */
+enum codec_format
+codec_for_program (char const *program)
+{
+  if (! program)
+    return codec_none;
+#if HAVE_ZLIB
+  if (strcmp (program, GZIP_PROGRAM) == 0)
+    return codec_gzip;
+#endif
+#if HAVE_LIBLZMA
+  if (strcmp (program, XZ_PROGRAM) == 0)
+    return codec_xz;
+#endif
+#if HAVE_LIBZSTD
+  if (strcmp (program, "zstd") == 0)
+    return codec_zstd;
+#endif
+  return codec_none;
+}
+
+static void codec_error (struct codec const *c, char const *message)
+  __attribute__ ((noreturn));
+
+static void
+codec_error (struct codec const *c, char const *message)
+{
+  if (c->compress)
+    FATAL_ERROR ((0, 0, _("%s library: %s"), c->program, message));
+
+  /* Exit with status 1 on bad input, as the decompression programs do.  */
+  ERROR ((0, 0, _("%s library: %s"), c->program, message));
+  exit (TAREXIT_DIFFERS);
+}
+
+#if HAVE_LIBLZMA
+static void
+xz_check (struct codec const *c, lzma_ret ret)
+{
+  switch (ret)
+    {
+    case LZMA_OK:
+    case LZMA_STREAM_END:
+      return;
+
+    case LZMA_MEM_ERROR:
+      xalloc_die ();
+
+    default:
+      codec_error (c, _("internal error"));
+    }
+}
+#endif
+
+#if HAVE_LIBZSTD
+static void
+zstd_check (struct codec const *c, size_t ret)
+{
+  if (ZSTD_isError (ret))
+    codec_error (c, ZSTD_getErrorName (ret));
+}
+#endif
+
+/* Start compressing a stream in FORMAT, which must not be codec_none,
+   with the default settings of its program.  */
+struct codec *
+compressor_open (enum codec_format format)
+{
+  struct codec *c = xzalloc (sizeof *c);
+
+  c->format = format;
+  c->compress = true;
+  c->buffer = xmalloc (CODEC_BUFFER_SIZE);
+  switch (format)
+    {
+#if HAVE_ZLIB
+    case codec_gzip:
+      c->program = GZIP_PROGRAM;
+      /* Adding 16 to the window size selects the gzip format.  */
+      switch (deflateInit2 (&c->gzip, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+			    MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY))
+	{
+	case Z_OK:
+	  break;
+	case Z_MEM_ERROR:
+	  xalloc_die ();
+	default:
+	  codec_error (c, c->gzip.msg ? c->gzip.msg : _("internal error"));
+	}
+      break;
+#endif
+
+#if HAVE_LIBLZMA
+    case codec_xz:
+      c->program = XZ_PROGRAM;
+      xz_check (c, lzma_easy_encoder (&c->xz, LZMA_PRESET_DEFAULT,
+				      LZMA_CHECK_CRC64));
+      break;
+#endif
+
+#if HAVE_LIBZSTD
+    case codec_zstd:
+      c->program = "zstd";
+      c->zstd = ZSTD_createCCtx ();
+      if (! c->zstd)
+	xalloc_die ();
+      /* Like the zstd program, add a checksum to each frame.  */
+      zstd_check (c, ZSTD_CCtx_setParameter (c->zstd, ZSTD_c_checksumFlag,
+					     1));
+      break;
+#endif
+
+    default:
+      abort ();
+    }
+  return c;
+}
+
+/* Compress the SIZE bytes at BUF with C, which finishes the stream if
+   FINISH is true, and pass the compressed data to OUTPUT.  SIZE must
+   not exceed CODEC_INPUT_MAX.  */
+static void
+compress_chunk (struct codec *c, char const *buf, size_t size, bool finish,
+		void (*output) (char const *, size_t))
+{
+  switch (c->format)
+    {
+#if HAVE_ZLIB
+    case codec_gzip:
+      {
+	int ret;
+	c->gzip.next_in = (Bytef *) buf;
+	c->gzip.avail_in = size;
+	do
+	  {
+	    c->gzip.next_out = (Bytef *) c->buffer;
+	    c->gzip.avail_out = CODEC_BUFFER_SIZE;
+	    ret = deflate (&c->gzip, finish ? Z_FINISH : Z_NO_FLUSH);
+	    if (ret == Z_STREAM_ERROR)
+	      codec_error (c, _("internal error"));
+	    output (c->buffer, CODEC_BUFFER_SIZE - c->gzip.avail_out);
+	  }
+	while (finish ? ret != Z_STREAM_END : c->gzip.avail_in != 0);
+      }
+      break;
+#endif
+
+#if HAVE_LIBLZMA
+    case codec_xz:
+      {
+	lzma_ret ret;
+	c->xz.next_in = (uint8_t const *) buf;
+	c->xz.avail_in = size;
+	do
+	  {
+	    c->xz.next_out = (uint8_t *) c->buffer;
+	    c->xz.avail_out = CODEC_BUFFER_SIZE;
+	    ret = lzma_code (&c->xz, finish ? LZMA_FINISH : LZMA_RUN);
+	    xz_check (c, ret);
+	    output (c->buffer, CODEC_BUFFER_SIZE - c->xz.avail_out);
+	  }
+	while (finish ? ret != LZMA_STREAM_END : c->xz.avail_in != 0);
+      }
+      break;
+#endif
+
+#if HAVE_LIBZSTD
+    case codec_zstd:
+      {
+	ZSTD_inBuffer in = { buf, size, 0 };
+	size_t left;
+	do
+	  {
+	    ZSTD_outBuffer out = { c->buffer, CODEC_BUFFER_SIZE, 0 };
+	    left = ZSTD_compressStream2 (c->zstd, &out, &in,
+					 finish ? ZSTD_e_end : ZSTD_e_continue);
+	    zstd_check (c, left);
+	    output (c->buffer, out.pos);
+	  }
+	while (finish ? left != 0 : in.pos < in.size);
+      }
+      break;
+#endif
+
+    default:
+      abort ();
+    }
+}
+
+/* Compress the SIZE bytes at BUF with C and pass whatever compressed
+   data are ready to OUTPUT.  */
+void
+compressor_write (struct codec *c, char const *buf, size_t size,
+		  void (*output) (char const *, size_t))
+{
+  while (size)
+    {
+      size_t n = size < CODEC_INPUT_MAX ? size : CODEC_INPUT_MAX;
+      compress_chunk (c, buf, n, false, output);
+      buf += n;
+      size -= n;
+    }
+}
+
+/* Free the codec C.  */
+static void
+codec_free (struct codec *c)
+{
+  switch (c->format)
+    {
+#if HAVE_ZLIB
+    case codec_gzip:
+      if (c->compress)
+	deflateEnd (&c->gzip);
+      else
+	inflateEnd (&c->gzip);
+      break;
+#endif
+
+#if HAVE_LIBLZMA
+    case codec_xz:
+      lzma_end (&c->xz);
+      break;
+#endif
+
+#if HAVE_LIBZSTD
+    case codec_zstd:
+      if (c->compress)
+	ZSTD_freeCCtx (c->zstd);
+      else
+	ZSTD_freeDCtx (c->unzstd);
+      break;
+#endif
+
+    default:
+      abort ();
+    }
+  free (c->buffer);
+  free (c);
+}
+
+/* Finish the stream compressed by C, pass the rest of it to OUTPUT,
+   and free C.  */
+void
+compressor_close (struct codec *c, void (*output) (char const *, size_t))
+{
+  compress_chunk (c, NULL, 0, true, output);
+  codec_free (c);
+}
+
+/* Start decompressing data in FORMAT, which must not be codec_none.
+   Like the program of the format, accept several compressed streams one
+   after another, and zeros after the last of them.  */
+struct codec *
+decompressor_open (enum codec_format format)
+{
+  struct codec *c = xzalloc (sizeof *c);
+
+  c->format = format;
+  c->buffer = xmalloc (CODEC_BUFFER_SIZE);
+  switch (format)
+    {
+#if HAVE_ZLIB
+    case codec_gzip:
+      c->program = GZIP_PROGRAM;
+      switch (inflateInit2 (&c->gzip, MAX_WBITS + 16))
+	{
+	case Z_OK:
+	  break;
+	case Z_MEM_ERROR:
+	  xalloc_die ();
+	default:
+	  codec_error (c, c->gzip.msg ? c->gzip.msg : _("internal error"));
+	}
+      break;
+#endif
+
+#if HAVE_LIBLZMA
+    case codec_xz:
+      c->program = XZ_PROGRAM;
+      c->xz_block_check = -1;
+      xz_check (c, lzma_stream_decoder (&c->xz, UINT64_MAX,
+					LZMA_CONCATENATED));
+      break;
+#endif
+
+#if HAVE_LIBZSTD
+    case codec_zstd:
+      c->program = "zstd";
+      c->unzstd = ZSTD_createDCtx ();
+      if (! c->unzstd)
+	xalloc_die ();
+      break;
+#endif
+
+    default:
+      abort ();
+    }
+  return c;
+}
+
+/* Start decompressing xz blocks whose integrity check is CHECK, one
+   after another, without the stream headers, indexes and footers
+   around them.  */
+struct codec *
+xz_blocks_decompressor_open (int check)
+{
+#if HAVE_LIBLZMA
+  struct codec *c = xzalloc (sizeof *c);
+
+  c->format = codec_xz;
+  c->program = XZ_PROGRAM;
+  c->buffer = xmalloc (CODEC_BUFFER_SIZE);
+  c->xz_block_check = check;
+  c->ended = true;
+  return c;
+#else
+  abort ();
+#endif
+}
+
+/* Check that the SIZE bytes at BUF, which follow the data decompressed
+   by C, are zeros, as they are in a padded record.  */
+static void
+check_padding (struct codec const *c, char const *buf, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i])
+      codec_error (c, _("trailing garbage"));
+}
+
+#if HAVE_LIBLZMA
+/* Start decoding the xz block whose header is in C->xz_header.  */
+static void
+xz_block_start (struct codec *c)
+{
+  lzma_filter filters[LZMA_FILTERS_MAX + 1];
+  lzma_block *block = &c->xz_block;
+  lzma_ret ret;
+  int i;
+
+  memset (block, 0, sizeof *block);
+  block->version = 0;
+  block->check = c->xz_block_check;
+  block->filters = filters;
+  block->header_size = c->xz_header_size;
+  ret = lzma_block_header_decode (block, NULL, c->xz_header);
+  if (ret != LZMA_OK)
+    codec_error (c, _("compressed data is corrupt"));
+  ret = lzma_block_decoder (&c->xz, block);
+  for (i = 0; filters[i].id != LZMA_VLI_UNKNOWN; i++)
+    free (filters[i].options);
+  block->filters = NULL;
+  xz_check (c, ret);
+}
+#endif
+
+/* Decompress with C at most CODEC_INPUT_MAX of the SIZE bytes at BUF,
+   and pass the decompressed data to OUTPUT.  Return the number of
+   bytes consumed.  */
+static size_t
+decompress_chunk (struct codec *c, char const *buf, size_t size,
+		  void (*output) (char const *, size_t))
+{
+  if (CODEC_INPUT_MAX < size)
+    size = CODEC_INPUT_MAX;
+
+  if (c->padding)
+    {
+      check_padding (c, buf, size);
+      return size;
+    }
+
+  switch (c->format)
+    {
+#if HAVE_ZLIB
+    case codec_gzip:
+      {
+	int ret;
+
+	if (c->ended)
+	  {
+	    if (! *buf)
+	      {
+		c->padding = true;
+		return 0;
+	      }
+	    inflateReset (&c->gzip);
+	    c->ended = false;
+	  }
+	c->gzip.next_in = (Bytef *) buf;
+	c->gzip.avail_in = size;
+	do
+	  {
+	    c->gzip.next_out = (Bytef *) c->buffer;
+	    c->gzip.avail_out = CODEC_BUFFER_SIZE;
+	    ret = inflate (&c->gzip, Z_NO_FLUSH);
+	    switch (ret)
+	      {
+	      case Z_OK:
+	      case Z_BUF_ERROR:
+		break;
+	      case Z_STREAM_END:
+		c->ended = true;
+		break;
+	      case Z_MEM_ERROR:
+		xalloc_die ();
+	      default:
+		codec_error (c, (c->gzip.msg ? c->gzip.msg
+				 : _("compressed data is corrupt")));
+	      }
+	    output (c->buffer, CODEC_BUFFER_SIZE - c->gzip.avail_out);
+	  }
+	while (! c->ended
+	       && (c->gzip.avail_in != 0 || c->gzip.avail_out == 0));
+	return size - c->gzip.avail_in;
+      }
+#endif
+
+#if HAVE_LIBLZMA
+    case codec_xz:
+      {
+	lzma_ret ret;
+
+	/* Collect the header of the next block first.  */
+	if (0 <= c->xz_block_check && c->ended)
+	  {
+	    size_t n;
+	    if (! c->xz_header_size)
+	      {
+		c->xz_header_size = ((unsigned char) *buf + 1) * 4;
+		c->xz_header_read = 0;
+		if (! *buf)
+		  codec_error (c, _("compressed data is corrupt"));
+	      }
+	    n = min (size, c->xz_header_size - c->xz_header_read);
+	    memcpy (c->xz_header + c->xz_header_read, buf, n);
+	    c->xz_header_read += n;
+	    if (c->xz_header_read == c->xz_header_size)
+	      {
+		xz_block_start (c);
+		c->xz_header_size = 0;
+		c->ended = false;
+	      }
+	    return n;
+	  }
+
+	c->xz.next_in = (uint8_t const *) buf;
+	c->xz.avail_in = size;
+	do
+	  {
+	    c->xz.next_out = (uint8_t *) c->buffer;
+	    c->xz.avail_out = CODEC_BUFFER_SIZE;
+	    ret = lzma_code (&c->xz, LZMA_RUN);
+	    switch (ret)
+	      {
+	      case LZMA_OK:
+	      case LZMA_BUF_ERROR:
+		break;
+	      case LZMA_STREAM_END:
+		c->ended = true;
+		break;
+	      case LZMA_MEM_ERROR:
+		xalloc_die ();
+	      case LZMA_FORMAT_ERROR:
+		codec_error (c, _("file format not recognized"));
+	      default:
+		codec_error (c, _("compressed data is corrupt"));
+	      }
+	    output (c->buffer, CODEC_BUFFER_SIZE - c->xz.avail_out);
+	  }
+	while (! c->ended
+	       && (c->xz.avail_in != 0 || c->xz.avail_out == 0));
+	return size - c->xz.avail_in;
+      }
+#endif
+
+#if HAVE_LIBZSTD
+    case codec_zstd:
+      {
+	ZSTD_inBuffer in = { buf, size, 0 };
+	ZSTD_outBuffer out;
+
+	if (c->ended && ! *buf)
+	  {
+	    c->padding = true;
+	    return 0;
+	  }
+	c->ended = false;
+	do
+	  {
+	    size_t ret;
+	    out.dst = c->buffer;
+	    out.size = CODEC_BUFFER_SIZE;
+	    out.pos = 0;
+	    ret = ZSTD_decompressStream (c->unzstd, &out, &in);
+	    zstd_check (c, ret);
+	    output (c->buffer, out.pos);
+	    c->ended = ret == 0;
+	  }
+	while (! c->ended && (in.pos < in.size || out.pos == out.size));
+	return in.pos;
+      }
+#endif
+
+    default:
+      abort ();
+    }
+}
+
+/* Decompress with C the SIZE bytes at BUF, and pass whatever
+   decompressed data are ready to OUTPUT.  */
+void
+decompressor_write (struct codec *c, char const *buf, size_t size,
+		    void (*output) (char const *, size_t))
+{
+  while (size)
+    {
+      size_t n = decompress_chunk (c, buf, size, output);
+      buf += n;
+      size -= n;
+    }
+}
+
+/* Check that the data decompressed by C ended where they should, and
+   free C.  */
+void
+decompressor_close (struct codec *c)
+{
+#if HAVE_LIBLZMA
+  if (c->format == codec_xz && c->xz_block_check < 0 && ! c->ended)
+    {
+      /* Let a concatenated stream end, after any padding.  */
+      c->xz.avail_in = 0;
+      c->xz.next_out = (uint8_t *) c->buffer;
+      c->xz.avail_out = CODEC_BUFFER_SIZE;
+      if (lzma_code (&c->xz, LZMA_FINISH) == LZMA_STREAM_END)
+	c->ended = true;
+    }
+  if (c->format == codec_xz && 0 <= c->xz_block_check && c->xz_header_size)
+    c->ended = false;
+#endif
+  if (! (c->ended || c->padding))
+    codec_error (c, _("unexpected end of input"));
+  codec_free (c);
+}
+
+/* Reading the compressed archive open on FD, SIZE bytes long, at random
+   offsets, through a buffer.  */
+struct frame_scan
+{
+  int fd;
+  off_t size;
+  off_t start;			/* Offset of the data in BUF */
+  size_t length;		/* Number of bytes of data in BUF */
+  char buf[CODEC_BUFFER_SIZE];
+};
+
+/* Read SIZE bytes at OFFSET of the archive scanned by S into BUF.
+   Return false if there are not that many.  */
+static bool
+scan_read (struct frame_scan *s, off_t offset, void *buf, size_t size)
+{
+  if (offset < 0 || s->size - offset < (off_t) size)
+    return false;
+  if (! (s->start <= offset
+	 && offset + (off_t) size <= s->start + (off_t) s->length))
+    {
+      size_t n;
+      if (lseek (s->fd, offset, SEEK_SET) != offset)
+	return false;
+      n = safe_read (s->fd, s->buf, sizeof s->buf);
+      if (n == SAFE_READ_ERROR || n < size)
+	return false;
+      s->start = offset;
+      s->length = n;
+    }
+  memcpy (buf, s->buf + (offset - s->start), size);
+  return true;
+}
+
+/* Frames of fewer bytes than this are decompressed together with the
+   frames that follow them, to save starting a process for each.  */
+enum { CODEC_FRAME_MIN = 1024 * 1024 };
+
+/* Append to the *COUNT frames at *FRAMES, of which *ALLOCATED are
+   allocated, the SIZE bytes at OFFSET whose xz check is CHECK, or -1
+   if they are whole streams.  Add them to the last frame instead if
+   they follow it and it is small.  */
+static void
+add_frame (struct codec_frame **frames, size_t *count, size_t *allocated,
+	   off_t offset, off_t size, int check)
+{
+  if (*count)
+    {
+      struct codec_frame *last = &(*frames)[*count - 1];
+      if (last->check == check && last->offset + last->size == offset
+	  && last->size < CODEC_FRAME_MIN)
+	{
+	  last->size += size;
+	  return;
+	}
+    }
+  if (*count == *allocated)
+    *frames = x2nrealloc (*frames, allocated, sizeof **frames);
+  (*frames)[*count].offset = offset;
+  (*frames)[*count].size = size;
+  (*frames)[*count].check = check;
+  ++*count;
+}
+
+/* Return the little-endian number in the N bytes at P.  */
+static uintmax_t
+get_le (unsigned char const *p, int n)
+{
+  uintmax_t v = 0;
+  while (n--)
+    v = (v << 8) | p[n];
+  return v;
+}
+
+/* Store into *FRAMES the zstd frames of the archive scanned by S, and
+   return their number.  Return 0 if the archive cannot be split.  The
+   size of a frame is not in its header, but the size of each of its
+   blocks is in the header of the block.  */
+static size_t
+find_zstd_frames (struct frame_scan *s, struct codec_frame **frames)
+{
+  static int const dict_id_size[] = { 0, 1, 2, 4 };
+  size_t count = 0;
+  size_t allocated = 0;
+  off_t pos = 0;
+
+  while (pos < s->size)
+    {
+      unsigned char h[6];
+      off_t start = pos;
+      uintmax_t magic;
+
+      if (! scan_read (s, pos, h, 1))
+	break;
+      if (h[0] == 0)
+	break;			/* Padding up to the end.  */
+      if (! scan_read (s, pos, h, 5))
+	break;
+      magic = get_le (h, 4);
+      if (magic == 0xFD2FB528)
+	{
+	  int descriptor = h[4];
+	  bool single_segment = descriptor & 0x20;
+	  int fcs_flag = descriptor >> 6;
+	  bool last;
+
+	  pos += (5 + ! single_segment + dict_id_size[descriptor & 3]
+		  + (fcs_flag ? 1 << fcs_flag : single_segment));
+	  do
+	    {
+	      uintmax_t block;
+	      int type;
+	      if (! scan_read (s, pos, h, 3))
+		goto fail;
+	      block = get_le (h, 3);
+	      last = block & 1;
+	      type = (block >> 1) & 3;
+	      if (type == 3)
+		goto fail;
+	      /* An RLE block holds a single byte.  */
+	      pos += 3 + (type == 1 ? 1 : block >> 3);
+	    }
+	  while (! last);
+	  if (descriptor & 4)
+	    pos += 4;		/* Checksum.  */
+	}
+      else if ((magic & 0xFFFFFFF0) == 0x184D2A50)
+	{
+	  /* A skippable frame.  */
+	  if (! scan_read (s, pos + 4, h, 4))
+	    goto fail;
+	  pos += 8 + get_le (h, 4);
+	}
+      else
+	goto fail;
+
+      if (s->size < pos)
+	goto fail;
+      add_frame (frames, &count, &allocated, start, pos - start, -1);
+    }
+  return count;
+
+ fail:
+  free (*frames);
+  *frames = NULL;
+  return 0;
+}
+
+#if HAVE_LIBLZMA
+/* Store into *FRAMES the xz streams of the archive scanned by S, and
+   return their number.  Return 0 if the archive cannot be split.
+   Streams of a single block are taken as they are.  Streams of several
+   blocks, as written by xz with more than one thread, are split into
+   their blocks, whose offsets and sizes are in the index of the stream.
+   The streams are found from the end of the archive, as the footer of
+   each stream gives the size of its index.  */
+static size_t
+find_xz_frames (struct frame_scan *s, struct codec_frame **frames)
+{
+  size_t count = 0;
+  size_t allocated = 0;
+  off_t pos = s->size;
+  uint8_t *index_buf = NULL;
+  size_t i;
+
+  while (0 < pos)
+    {
+      uint8_t buf[LZMA_STREAM_HEADER_SIZE];
+      lzma_stream_flags footer, header;
+      lzma_index *index = NULL;
+      uint64_t memlimit = UINT64_MAX;
+      size_t in_pos = 0;
+      off_t index_start, stream_start;
+      lzma_index_iter iter;
+
+      /* Skip the stream padding, and the padding of the last record.  */
+      if (! scan_read (s, pos - 4, buf, 4))
+	goto fail;
+      if (get_le (buf, 4) == 0)
+	{
+	  pos -= 4;
+	  continue;
+	}
+
+      if (! (scan_read (s, pos - LZMA_STREAM_HEADER_SIZE, buf,
+			LZMA_STREAM_HEADER_SIZE)
+	     && lzma_stream_footer_decode (&footer, buf) == LZMA_OK))
+	goto fail;
+      index_start = pos - LZMA_STREAM_HEADER_SIZE - footer.backward_size;
+      if (index_start < LZMA_STREAM_HEADER_SIZE)
+	goto fail;
+      index_buf = xrealloc (index_buf, footer.backward_size);
+      if (lseek (s->fd, index_start, SEEK_SET) != index_start
+	  || safe_read (s->fd, index_buf, footer.backward_size)
+	     != footer.backward_size)
+	goto fail;
+      if (lzma_index_buffer_decode (&index, &memlimit, NULL, index_buf,
+				    &in_pos, footer.backward_size)
+	  != LZMA_OK)
+	goto fail;
+
+      stream_start = pos - lzma_index_stream_size (index);
+      if (! (0 <= stream_start
+	     && scan_read (s, stream_start, buf, LZMA_STREAM_HEADER_SIZE)
+	     && lzma_stream_header_decode (&header, buf) == LZMA_OK
+	     && lzma_stream_flags_compare (&header, &footer) == LZMA_OK))
+	{
+	  lzma_index_end (index, NULL);
+	  goto fail;
+	}
+
+      /* Add the frames backwards, to be reversed at the end.  */
+      if (lzma_index_block_count (index) <= 1)
+	add_frame (frames, &count, &allocated, stream_start,
+		   pos - stream_start, -1);
+      else
+	{
+	  size_t first = count;
+	  lzma_index_iter_init (&iter, index);
+	  while (! lzma_index_iter_next (&iter, LZMA_INDEX_ITER_BLOCK))
+	    add_frame (frames, &count, &allocated,
+		       stream_start + iter.block.compressed_stream_offset,
+		       iter.block.total_size, header.check);
+	  for (i = 0; i < (count - first) / 2; i++)
+	    {
+	      struct codec_frame f = (*frames)[first + i];
+	      (*frames)[first + i] = (*frames)[count - 1 - i];
+	      (*frames)[count - 1 - i] = f;
+	    }
+	}
+      lzma_index_end (index, NULL);
+      pos = stream_start;
+    }
+
+  free (index_buf);
+  for (i = 0; i < count / 2; i++)
+    {
+      struct codec_frame f = (*frames)[i];
+      (*frames)[i] = (*frames)[count - 1 - i];
+      (*frames)[count - 1 - i] = f;
+    }
+  return count;
+
+ fail:
+  free (index_buf);
+  free (*frames);
+  *frames = NULL;
+  return 0;
+}
+#endif
+
+/* Find the parts of the archive open on FD, compressed in FORMAT, that
+   can be decompressed independently of one another: the frames of a
+   zstd archive, and the streams of an xz archive, or their blocks.
+   Store them into *FRAMES, in order, and return their number.  Return
+   0 if the archive cannot be split, as gzip archives cannot.  The
+   offset of FD is left as it was.  */
+size_t
+codec_find_frames (enum codec_format format, int fd,
+		   struct codec_frame **frames)
+{
+  struct frame_scan *s;
+  struct stat st;
+  size_t count = 0;
+  off_t offset;
+
+  *frames = NULL;
+  if (fstat (fd, &st) != 0 || ! S_ISREG (st.st_mode))
+    return 0;
+  offset = lseek (fd, 0, SEEK_CUR);
+  if (offset < 0)
+    return 0;
+  s = xmalloc (sizeof *s);
+  s->fd = fd;
+  s->size = st.st_size;
+  s->start = 0;
+  s->length = 0;
+
+  switch (format)
+    {
+    case codec_zstd:
+      count = find_zstd_frames (s, frames);
+      break;
+
+#if HAVE_LIBLZMA
+    case codec_xz:
+      count = find_xz_frames (s, frames);
+      break;
+#endif
+
+    default:
+      break;
+    }
+
+  free (s);
+  if (lseek (fd, offset, SEEK_SET) != offset)
+    {
+      free (*frames);
+      *frames = NULL;
+      return 0;
+    }
+  return count;
+}
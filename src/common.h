@@ -143,6 +143,10 @@ GLOBAL const char *use_compress_program_option;
 GLOBAL bool dereference_option;
 GLOBAL bool hard_dereference_option;
 
+/* Keep the names of hard-linked files in a temporary file rather than
+   in memory.  */
+GLOBAL bool spill_link_names_option;
+
 /* Patterns that match file names to be excluded.  */
 GLOBAL struct exclude *excluded;
 
@@ -194,6 +198,14 @@ GLOBAL bool keep_directory_symlink_option;
 
 /* Specified file name for incremental list.  */
 GLOBAL const char *listed_incremental_option;
+/* File to write the index of created archive members to.  */
+GLOBAL const char *create_index_option;
+/* File to read the index of archive members from.  */
+GLOBAL const char *use_index_option;
+/* Store the index of members at the end of the created archive.  */
+GLOBAL bool embed_index_option;
+/* List the archive using its embedded index.  */
+GLOBAL bool fast_list_option;
 /* Incremental dump level */
 GLOBAL int incremental_level;
 /* Check device numbers when doing incremental dumps. */
@@ -255,6 +267,30 @@ GLOBAL bool recursive_unlink_option;
 
 GLOBAL bool read_full_records_option;
 
+/* Number of directory entries whose data are read ahead when creating
+   an archive.  */
+GLOBAL size_t read_ahead_option;
+
+/* Number of processes that look up and read ahead directory entries
+   on behalf of tar, or 0 to do it in tar itself.  */
+GLOBAL size_t read_ahead_workers_option;
+
+/* Number of records that may be queued for writing to the archive.  */
+GLOBAL size_t write_queue_option;
+
+/* Number of records that may be read ahead from the archive.  */
+GLOBAL size_t read_queue_option;
+
+/* Number of processes writing the data of extracted files.  */
+GLOBAL size_t extract_workers_option;
+
+/* Number of archive bytes after which the compression program is
+   restarted, or 0 to compress the archive as a single stream.  */
+GLOBAL off_t frame_size_option;
+
+/* Number of frames compressed at a time.  */
+GLOBAL size_t compress_workers_option;
+
 GLOBAL bool remove_files_option;
 
 /* Specified remote shell command.  */
@@ -291,11 +327,30 @@ enum hole_detection_method
   {
     HOLE_DETECTION_DEFAULT,
     HOLE_DETECTION_RAW,
-    HOLE_DETECTION_SEEK
+    HOLE_DETECTION_SEEK,
+    HOLE_DETECTION_FIEMAP
   };
 
 GLOBAL enum hole_detection_method hole_detection;
 
+enum preallocate_mode
+  {
+    PREALLOCATE_NONE,   /* Do not allocate space before extracting */
+    PREALLOCATE_DATA,   /* Allocate space for the data of extracted files */
+    PREALLOCATE_FULL    /* Allocate whole sparse files, then punch holes */
+  };
+
+GLOBAL enum preallocate_mode preallocate_option;
+
+enum cache_policy
+  {
+    CACHE_KEEP,         /* Leave file data in the page cache */
+    CACHE_DROP,         /* Drop file data from the page cache behind us */
+    CACHE_DIRECT        /* Bypass the page cache with O_DIRECT */
+  };
+
+GLOBAL enum cache_policy cache_policy_option;
+
 GLOBAL bool starting_file_option;
 
 /* Specified maximum byte length of each tape volume (multiple of 1024).  */
@@ -374,6 +429,8 @@ struct name
 				   Set with the -C option. */
     uintmax_t found_count;	/* number of times a matching file has
 				   been found */
+    size_t ordinal;		/* position in the name list, for
+				   matching */
 
     /* The following members are used for incremental dumps only,
        if this struct name represents a directory;
@@ -404,6 +461,10 @@ GLOBAL bool unquote_option;
 
 GLOBAL int savedir_sort_order;
 
+/* Sort directory entries by the location of their data on disk
+   (--sort=extent).  SAVEDIR_SORT_ORDER is then SAVEDIR_SORT_FASTREAD.  */
+GLOBAL bool sort_extent_option;
+
 /* Show file or archive names after transformation.
    In particular, when creating archive in verbose mode, list member names
    as stored in the archive */
@@ -447,6 +508,8 @@ char *drop_volume_label_suffix (const char *label);
 size_t available_space_after (union block *pointer);
 off_t current_block_ordinal (void);
 void close_archive (void);
+off_t copy_archive_to_file (int fd, off_t size, int *err);
+off_t copy_file_to_archive (int fd, off_t size);
 void closeout_volume_number (void);
 double compute_duration (void);
 union block *find_next_block (void);
@@ -463,6 +526,9 @@ void xclose (int fd);
 void archive_write_error (ssize_t status) __attribute__ ((noreturn));
 void archive_read_error (void);
 off_t seek_archive (off_t size);
+bool seek_archive_block (off_t block);
+bool compressed_archive_seekable (void);
+void restart_decompression (off_t offset, off_t block);
 void set_start_time (void);
 
 #define TF_READ    0
@@ -479,6 +545,7 @@ void mv_size_left (off_t size);
 
 void buffer_write_global_xheader (void);
 
+bool compress_program_allows_frames (char const *program);
 const char *first_decompress_program (int *pstate);
 const char *next_decompress_program (int *pstate);
 
@@ -539,6 +606,7 @@ void extract_finish (void);
 bool rename_directory (char *src, char *dst);
 
 void remove_delayed_set_stat (const char *fname);
+void forget_known_directory (char const *file_name);
 
 /* Module delete.c.  */
 
@@ -724,6 +792,29 @@ pid_t xfork (void);
 void xpipe (int fd[2]);
 
 void *page_aligned_alloc (void **ptr, size_t size);
+
+/* How the data of a file being read or written are cached.  */
+struct cache_control
+{
+  int fd;                       /* The file */
+  bool writing;                 /* True if it is being written */
+  bool direct;                  /* True if O_DIRECT is on */
+  enum cache_policy policy;     /* The policy in effect for it */
+  off_t offset;                 /* Bytes read or written so far */
+  off_t mark;                   /* Offset at the last cache_drop */
+  off_t dropped;                /* Bytes dropped from the page cache */
+  char *buffer;                 /* Buffer for O_DIRECT */
+  size_t buffer_used;           /* Bytes of data in it */
+  size_t buffer_pos;            /* Bytes of it already read */
+};
+
+void cache_begin (struct cache_control *c, int fd, off_t size, bool writing,
+		  enum cache_policy policy);
+void cache_advance (struct cache_control *c, off_t size);
+size_t cache_read (struct cache_control *c, void *buf, size_t size);
+size_t cache_write (struct cache_control *c, void const *buf, size_t size);
+bool cache_end (struct cache_control *c);
+
 int set_file_atime (int fd, int parentfd, char const *file,
 		    struct timespec atime);
 
@@ -746,6 +837,7 @@ struct name *addname (char const *string, int change_dir,
 		      bool cmdline, struct name *parent);
 void remname (struct name *name);
 bool name_match (const char *name);
+bool name_wanted_p (const char *file_name);
 void names_notfound (void);
 void label_notfound (void);
 void collect_and_sort_names (void);
@@ -846,6 +938,7 @@ void xheader_xattr_add (struct tar_stat_info *st,
 void sys_detect_dev_null_output (void);
 void sys_save_archive_dev_ino (void);
 void sys_wait_for_child (pid_t, bool);
+void sys_kill_child (pid_t);
 void sys_spawn_shell (void);
 bool sys_compare_uid (struct stat *a, struct stat *b);
 bool sys_compare_gid (struct stat *a, struct stat *b);
@@ -853,9 +946,31 @@ bool sys_file_is_archive (struct tar_stat_info *p);
 bool sys_compare_links (struct stat *link_data, struct stat *stat_data);
 int sys_truncate (int fd);
 pid_t sys_child_open_for_compress (void);
-pid_t sys_child_open_for_uncompress (void);
+pid_t sys_child_open_for_uncompress (off_t offset);
+bool sys_archive_file_is_regular (void);
+pid_t sys_child_open_for_write (void);
+pid_t sys_child_open_for_read (void);
+
+/* Maximum number of descriptors passed at a time by sys_send_full.  */
+enum { SYS_FDS_MAX = 64 };
+
+void sys_socketpair (int sv[2], bool packets);
+bool sys_send_full (int sock, int const *fds, size_t nfds,
+		    void const *buf, size_t size);
+bool sys_recv_full (int sock, int *fds, size_t *nfds, void *buf, size_t size);
+bool sys_send_packet (int sock, int fd, void const *buf, size_t size);
+ssize_t sys_recv_packet (int sock, int *fd, void *buf, size_t size);
+bool sys_file_extent (int dirfd, char const *name, off_t *offset);
+ssize_t sys_file_data_extents (int fd, off_t *offset, struct sp_array *map,
+			       size_t n, bool *last);
+bool sys_allocate (int fd, off_t offset, off_t size, bool keep_size);
+bool sys_punch_hole (int fd, off_t offset, off_t size);
+size_t sys_open_files_max (void);
 size_t sys_write_archive_buffer (void);
 bool sys_get_archive_stat (void);
+bool sys_archive_is_regular (void);
+ssize_t sys_copy_to_archive (int fd, size_t size);
+ssize_t sys_copy_from_archive (int fd, size_t size);
 int sys_exec_command (char *file_name, int typechar, struct tar_stat_info *st);
 void sys_wait_command (void);
 int sys_exec_info_script (const char **archive_name, int volume_number);
@@ -961,9 +1076,60 @@ extern void (*fatal_exit_hook) (void);
 void excfile_add (const char *name, int flags);
 void info_attach_exclist (struct tar_stat_info *dir);
 void info_free_exclist (struct tar_stat_info *dir);
+void add_exclude_indexed (struct exclude *ex, char const *pattern, int options);
 bool excluded_name (char const *name, struct tar_stat_info *st);
 void exclude_vcs_ignores (void);
 
+/* Module tarindex.c */
+void index_create_start (void);
+void index_add_header (char typeflag, char const *name, off_t block_ordinal);
+void index_add_member (struct tar_stat_info const *st, char typeflag,
+		       off_t block_ordinal);
+int index_frames_fd (void);
+void index_embed (void);
+void index_create_finish (void);
+void index_load (void);
+size_t index_frames_from (off_t offset, off_t const **offsets);
+void index_list_members (void);
+bool index_seek_member (void);
+void index_check_member (enum read_header status,
+			 struct tar_stat_info const *st);
+
+/* Module codec.c */
+
+enum codec_format
+  {
+    codec_none,
+    codec_gzip,
+    codec_xz,
+    codec_zstd
+  };
+
+struct codec;
+
+/* A part of a compressed archive that can be decompressed on its own */
+struct codec_frame
+{
+  off_t offset;			/* Offset in the archive */
+  off_t size;			/* Number of bytes */
+  int check;			/* xz check of the blocks, or -1 if the part
+				   is made of whole streams or frames */
+};
+
+enum codec_format codec_for_program (char const *program);
+struct codec *compressor_open (enum codec_format format);
+void compressor_write (struct codec *c, char const *buf, size_t size,
+		       void (*output) (char const *, size_t));
+void compressor_close (struct codec *c,
+		       void (*output) (char const *, size_t));
+struct codec *decompressor_open (enum codec_format format);
+struct codec *xz_blocks_decompressor_open (int check);
+void decompressor_write (struct codec *c, char const *buf, size_t size,
+			 void (*output) (char const *, size_t));
+void decompressor_close (struct codec *c);
+size_t codec_find_frames (enum codec_format format, int fd,
+			  struct codec_frame **frames);
+
 /* Module map.c */
 void owner_map_read (char const *name);
 int owner_map_translate (uid_t uid, uid_t *new_uid, char const **new_name);
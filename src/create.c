@@ -40,6 +40,12 @@ struct link
     dev_t dev;
     ino_t ino;
     nlink_t nlink;
+
+    /* With --spill-link-names, the offset and size of the name in
+       link_name_file; otherwise NAME_OFFSET is -1.  */
+    off_t name_offset;
+    size_t name_size;
+
     char name[1];
   };
 
@@ -1028,6 +1034,8 @@ void
 finish_header (struct tar_stat_info *st,
 	       union block *header, off_t block_ordinal)
 {
+  char typeflag = header->header.typeflag;
+
   /* Note: It is important to do this before the call to write_extended(),
      so that the actual ustar header is printed */
   if (verbose_option
@@ -1043,6 +1051,11 @@ finish_header (struct tar_stat_info *st,
 
   header = write_extended (false, st, header);
   simple_finish_header (header);
+
+  if ((create_index_option || embed_index_option)
+      && typeflag != GNUTYPE_LONGLINK && typeflag != GNUTYPE_LONGNAME
+      && typeflag != XHDTYPE && typeflag != XGLTYPE)
+    index_add_member (st, typeflag, block_ordinal);
 }
 
 
@@ -1065,6 +1078,7 @@ dump_regular_file (int fd, struct tar_stat_info *st)
   off_t size_left = st->stat.st_size;
   off_t block_ordinal;
   union block *blk;
+  struct cache_control cache;
 
   block_ordinal = current_block_ordinal ();
   blk = start_header (st);
@@ -1078,10 +1092,24 @@ dump_regular_file (int fd, struct tar_stat_info *st)
   finish_header (st, blk, block_ordinal);
 
   mv_begin_write (st->file_name, st->stat.st_size, st->stat.st_size);
+  cache_begin (&cache, fd, st->stat.st_size, false,
+	       fd > 0 ? cache_policy_option : CACHE_KEEP);
   while (size_left > 0)
     {
       size_t bufsize, count;
 
+      /* Copy whole records of data straight into the archive, if
+	 possible.  O_DIRECT reads, and data already read into the cache
+	 buffer, must go through cache_read.  */
+      if (fd > 0 && ! cache.direct && cache.buffer_pos == cache.buffer_used)
+	{
+	  off_t copied = copy_file_to_archive (fd, size_left);
+	  cache_advance (&cache, copied);
+	  size_left -= copied;
+	  if (size_left == 0)
+	    break;
+	}
+
       blk = find_next_block ();
 
       bufsize = available_space_after (blk);
@@ -1095,11 +1123,12 @@ dump_regular_file (int fd, struct tar_stat_info *st)
 	    memset (blk->buffer + size_left, 0, BLOCKSIZE - count);
 	}
 
-      count = (fd <= 0) ? bufsize : blocking_read (fd, blk->buffer, bufsize);
+      count = (fd <= 0) ? bufsize : cache_read (&cache, blk->buffer, bufsize);
       if (count == SAFE_READ_ERROR)
 	{
 	  read_diag_details (st->orig_file_name,
 	                     st->stat.st_size - size_left, bufsize);
+	  cache_end (&cache);
 	  pad_archive (size_left);
 	  return dump_status_short;
 	}
@@ -1119,16 +1148,472 @@ dump_regular_file (int fd, struct tar_stat_info *st)
 		    STRINGIFY_BIGINT (size_left, buf)));
 	  if (! ignore_failed_read_option)
 	    set_exit_status (TAREXIT_DIFFERS);
+	  cache_end (&cache);
 	  pad_archive (size_left - (bufsize - count));
 	  return dump_status_short;
 	}
     }
+  cache_end (&cache);
   return dump_status_ok;
 }
 
-
+/* Maximum number of bytes of a single file to read ahead.  */
+#define READ_AHEAD_MAX (16 * 1024 * 1024)
+
+/* What was found about an entry looked up ahead of time.  */
+struct read_ahead_reply
+{
+  bool found;			/* True if STAT holds its status */
+  struct stat stat;		/* Its status */
+};
+
+/* Look up the entry FILE of the directory open on DIRFD and store its
+   status into *REPLY.  If dump_file0 would open it, open it and return
+   the descriptor, after asking the kernel to start reading a regular
+   file into the page cache, so that its data are at hand by the time
+   dump_regular_file gets to it.  Otherwise return -1.  Failures are
+   not diagnosed: dump_file0 looks the entry up again in that case.  */
+static int
+read_ahead_file (int dirfd, char const *file, struct read_ahead_reply *reply)
+{
+  int fd = -1;
+
+  memset (reply, 0, sizeof *reply);
+  if (fstatat (dirfd, file, &reply->stat, fstatat_flags) != 0)
+    return -1;
+  if (file_dumpable_p (&reply->stat))
+    {
+      fd = openat (dirfd, file, open_read_flags);
+      if (fd < 0)
+	return -1;
+      if (fstat (fd, &reply->stat) != 0)
+	{
+	  close (fd);
+	  return -1;
+	}
+#ifdef POSIX_FADV_WILLNEED
+      if (S_ISREG (reply->stat.st_mode) && reply->stat.st_size != 0)
+	posix_fadvise (fd, 0, min (reply->stat.st_size, READ_AHEAD_MAX),
+		       POSIX_FADV_WILLNEED);
+#endif
+    }
+  reply->found = true;
+  return fd;
+}
+
+/* Processes that look up directory entries ahead on behalf of tar, so
+   that the latency of the lookups overlaps with archiving.  Each is
+   handed the directory the entries are in once, as a descriptor, and
+   then the name of each entry, over a packet socket.  For each entry
+   it sends back its status and, if the entry is to be read, a
+   descriptor open on it, which dump_file0 then uses instead of
+   looking the entry up again.  */
+struct read_ahead_worker
+{
+  pid_t pid;			/* Process ID of the worker */
+  int sock;			/* Socket to send entries to */
+  uintmax_t dir_serial;		/* Serial number of its directory */
+};
+
+static struct read_ahead_worker *read_ahead_workers;
+static size_t read_ahead_worker_next;
+
+/* Serial number of the last directory whose entries were read ahead.
+   Each directory gets its own, so that a worker that was handed a
+   subdirectory is handed its parent again when tar returns to it.  */
+static uintmax_t read_ahead_dir_serial;
+
+/* An entry being read ahead.  */
+struct read_ahead_entry
+{
+  char const *name;		/* Its name, in the buffer of its directory */
+  struct read_ahead_worker *worker; /* Worker looking it up, if any */
+  int fd;			/* Descriptor open on it, or -1 */
+  struct read_ahead_reply reply; /* What was found */
+};
+
+/* Entries being read ahead, in the order they are to be archived: a
+   ring of READ_AHEAD_RING_SIZE entries, of which READ_AHEAD_RING_COUNT
+   starting at READ_AHEAD_RING_HEAD are in use.  All of them are from
+   the directory being archived.  */
+static struct read_ahead_entry *read_ahead_ring;
+static size_t read_ahead_ring_size;
+static size_t read_ahead_ring_head;
+static size_t read_ahead_ring_count;
+
+/* Number of times entries read ahead were dropped.  */
+static uintmax_t read_ahead_cancels;
+
+/* The entry that dump_file0 is about to archive, if it was read ahead.
+   dump_file0 resets this when it takes it over.  */
+static struct read_ahead_entry *read_ahead_result;
+
+static void
+read_ahead_worker_main (int sock)
+{
+  char file[NAME_MAX < 4096 ? 4096 : NAME_MAX + 1];
+  int dirfd = -1;
+
+  for (;;)
+    {
+      int fd;
+      struct read_ahead_reply reply;
+      ssize_t n = sys_recv_packet (sock, &fd, file, sizeof file - 1);
+
+      if (0 <= fd)
+	{
+	  if (0 <= dirfd)
+	    close (dirfd);
+	  dirfd = fd;
+	}
+      if (n == 0 || (n < 0 && errno != EMSGSIZE))
+	break;
+
+      /* Every entry gets a reply, so that tar can match them up.  */
+      fd = -1;
+      memset (&reply, 0, sizeof reply);
+      if (0 < n && 0 <= dirfd)
+	{
+	  file[n] = '\0';
+	  fd = read_ahead_file (dirfd, file, &reply);
+	}
+      if (! sys_send_full (sock, &fd, 0 <= fd, &reply, sizeof reply))
+	break;
+      if (0 <= fd)
+	close (fd);
+    }
+
+  exit (TAREXIT_SUCCESS);
+}
+
+static void
+start_read_ahead (void)
+{
+  size_t i;
+
+  /* The entries read ahead are kept open, so keep well within the
+     limit on open files.  */
+  read_ahead_ring_size = max (1, min (read_ahead_option,
+				      sys_open_files_max () / 4));
+  read_ahead_ring = xnmalloc (read_ahead_ring_size, sizeof *read_ahead_ring);
+
+  if (! read_ahead_workers_option)
+    return;
+
+  read_ahead_workers = xcalloc (read_ahead_workers_option,
+				sizeof *read_ahead_workers);
+
+  /* Don't let the workers inherit buffered output.  */
+  fflush (NULL);
+
+  for (i = 0; i < read_ahead_workers_option; i++)
+    {
+      int sv[2];
+      pid_t pid;
+
+      sys_socketpair (sv, true);
+      pid = xfork ();
+      if (pid == 0)
+	{
+	  size_t j;
+
+	  set_program_name (_("tar (child)"));
+	  fatal_exit_hook = NULL;
+	  for (j = 0; j < i; j++)
+	    close (read_ahead_workers[j].sock);
+	  close (sv[0]);
+	  read_ahead_worker_main (sv[1]);
+	}
+
+      close (sv[1]);
+      read_ahead_workers[i].pid = pid;
+      read_ahead_workers[i].sock = sv[0];
+    }
+}
+
+/* If FILE is the next entry read ahead, store what was found about it
+   into *E and return true.  The caller must then release *E.  */
+static bool
+read_ahead_take (char const *file, struct read_ahead_entry *e)
+{
+  struct read_ahead_entry const *head;
+
+  if (! read_ahead_ring_count)
+    return false;
+  head = &read_ahead_ring[read_ahead_ring_head];
+  if (head->name != file)
+    return false;
+
+  *e = *head;
+  read_ahead_ring_head = (read_ahead_ring_head + 1) % read_ahead_ring_size;
+  read_ahead_ring_count--;
+
+  if (e->worker)
+    {
+      ssize_t n = sys_recv_packet (e->worker->sock, &e->fd,
+				   &e->reply, sizeof e->reply);
+      if (n != sizeof e->reply)
+	{
+	  if (0 <= e->fd)
+	    close (e->fd);
+	  e->fd = -1;
+	  e->reply.found = false;
+	}
+    }
+  return true;
+}
+
+/* Close the descriptor of the entry E, unless it was taken over.  */
+static void
+read_ahead_release (struct read_ahead_entry *e)
+{
+  if (0 <= e->fd)
+    close (e->fd);
+  e->fd = -1;
+}
+
+/* Drop the entries being read ahead.  */
+static void
+read_ahead_cancel (void)
+{
+  if (! read_ahead_ring_count)
+    return;
+  while (read_ahead_ring_count)
+    {
+      struct read_ahead_entry e;
+      read_ahead_take (read_ahead_ring[read_ahead_ring_head].name, &e);
+      read_ahead_release (&e);
+    }
+  read_ahead_cancels++;
+}
+
+static void
+finish_read_ahead (void)
+{
+  struct read_ahead_worker *workers = read_ahead_workers;
+  size_t i;
+
+  read_ahead_cancel ();
+  free (read_ahead_ring);
+  read_ahead_ring = NULL;
+  read_ahead_ring_size = 0;
+
+  if (! workers)
+    return;
+  read_ahead_workers = NULL;
+
+  for (i = 0; i < read_ahead_workers_option; i++)
+    close (workers[i].sock);
+
+  for (i = 0; i < read_ahead_workers_option; i++)
+    while (waitpid (workers[i].pid, NULL, 0) == -1)
+      if (errno != EINTR)
+	{
+	  waitpid_error (_("read-ahead worker"));
+	  break;
+	}
+
+  free (workers);
+  read_ahead_worker_next = 0;
+}
+
+/* Start reading ahead the entry FILE of the directory DIR, whose
+   serial number is SERIAL.  FILE must stay in place until it is
+   archived.  */
+static void
+read_ahead (struct tar_stat_info const *dir, uintmax_t serial,
+	    char const *file)
+{
+  struct read_ahead_entry *e;
+
+  if (dir->fd <= 0)
+    return;
+
+  if (! read_ahead_ring)
+    start_read_ahead ();
+  if (read_ahead_ring_count == read_ahead_ring_size)
+    return;
+  e = &read_ahead_ring[(read_ahead_ring_head + read_ahead_ring_count)
+		       % read_ahead_ring_size];
+
+  if (! read_ahead_workers_option)
+    {
+      /* Look the entry up right here, and keep what was found for
+	 dump_file0, so that only the posix_fadvise call is extra.  */
+      e->worker = NULL;
+      e->fd = read_ahead_file (dir->fd, file, &e->reply);
+    }
+  else
+    {
+      struct read_ahead_worker *w
+	= &read_ahead_workers[read_ahead_worker_next];
+      bool sent;
+
+      read_ahead_worker_next = ((read_ahead_worker_next + 1)
+				% read_ahead_workers_option);
+
+      /* A worker too busy to take the entry right away would not get
+	 to it in time anyway, so skip it rather than wait.  The
+	 directory is passed along with the first entry the worker
+	 takes from it.  */
+      if (w->dir_serial == serial)
+	sent = sys_send_packet (w->sock, -1, file, strlen (file));
+      else
+	{
+	  sent = sys_send_packet (w->sock, dir->fd, file, strlen (file));
+	  if (sent)
+	    w->dir_serial = serial;
+	}
+      if (! sent)
+	return;
+      e->worker = w;
+      e->fd = -1;
+    }
+
+  e->name = file;
+  read_ahead_ring_count++;
+}
+
+
+/* Maximum number of entries read at a time from a directory that is
+   archived while it is being read.  */
+enum { DIRECTORY_BATCH = 1024 };
+
+/* Read the next entries of the directory ST, which is archived while
+   it is being read, and return them in a dynamically allocated buffer
+   in the format of get_directory_entries.  The buffer is empty at the
+   end of the directory.  Return null on failure, setting errno.  */
+static char *
+read_directory_batch (struct tar_stat_info *st)
+{
+  char *buf = NULL;
+  size_t allocated = 0;
+  size_t used = 0;
+  size_t entries = 0;
+
+  if (! st->dirstream)
+    {
+      /* The stream was closed by open_failure_recover, which read the
+	 rest of the entries.  */
+      buf = st->dirrest;
+      st->dirrest = NULL;
+      return buf ? buf : xzalloc (1);
+    }
+
+  while (entries < DIRECTORY_BATCH)
+    {
+      struct dirent const *dp;
+      char const *entry;
+      size_t entry_size;
+
+      errno = 0;
+      dp = readdir (st->dirstream);
+      if (! dp)
+	{
+	  if (errno)
+	    {
+	      int e = errno;
+	      free (buf);
+	      errno = e;
+	      return NULL;
+	    }
+	  break;
+	}
+
+      /* Skip "", ".", and "..", as savedir does.  */
+      entry = dp->d_name;
+      if (entry[entry[0] != '.' ? 0 : entry[1] != '.' ? 1 : 2] == '\0')
+	continue;
+
+      entry_size = strlen (entry) + 1;
+      if (allocated - used <= entry_size)
+	{
+	  allocated = used + entry_size + 1;
+	  buf = x2realloc (buf, &allocated);
+	}
+      memcpy (buf + used, entry, entry_size);
+      used += entry_size;
+      entries++;
+    }
+
+  if (! buf)
+    return xzalloc (1);
+  buf[used] = '\0';
+  return buf;
+}
+
+/* Dump the entries of the directory ST listed in DIRECTORY, in the
+   format of get_directory_entries.  SERIAL is the serial number of ST
+   for read_ahead.  *NAME_BUF holds the name of ST, and is reallocated
+   as needed to hold the names of the entries; *NAME_SIZE is its size,
+   not counting the terminating null.  */
+static void
+dump_dir_entries (struct tar_stat_info *st, uintmax_t serial,
+		  char const *directory, char **name_buf, size_t *name_size)
+{
+  char const *entry;
+  size_t entry_len;
+  size_t name_len = strlen (st->orig_file_name);
+  char const *ahead = directory;
+  size_t ahead_count = 0;
+  uintmax_t cancels = read_ahead_cancels;
+
+  for (entry = directory; (entry_len = strlen (entry)) != 0;
+       entry += entry_len + 1)
+    {
+      struct read_ahead_entry looked_up;
+      bool read_ahead_done;
+
+      /* Keep the READ_AHEAD_OPTION entries that follow ENTRY being read
+	 in.  AHEAD points past the last of them, and AHEAD_COUNT is
+	 their number.  If they were dropped while a subdirectory was
+	 archived, start over.  */
+      if (read_ahead_option)
+	{
+	  if (cancels != read_ahead_cancels)
+	    {
+	      cancels = read_ahead_cancels;
+	      ahead = entry;
+	    }
+	  if (ahead <= entry)
+	    {
+	      ahead = entry + entry_len + 1;
+	      ahead_count = 0;
+	    }
+	  else
+	    ahead_count--;
+
+	  for (; ahead_count < read_ahead_option && *ahead; ahead_count++)
+	    {
+	      read_ahead (st, serial, ahead);
+	      ahead += strlen (ahead) + 1;
+	    }
+	}
+
+      if (*name_size < name_len + entry_len)
+	{
+	  *name_size = name_len + entry_len;
+	  *name_buf = xrealloc (*name_buf, *name_size + 1);
+	}
+      strcpy (*name_buf + name_len, entry);
+      read_ahead_done = read_ahead_take (entry, &looked_up);
+      if (!excluded_name (*name_buf, st))
+	{
+	  read_ahead_result = read_ahead_done ? &looked_up : NULL;
+	  dump_file (st, entry, *name_buf);
+	  read_ahead_result = NULL;
+	}
+      if (read_ahead_done)
+	read_ahead_release (&looked_up);
+    }
+
+  /* The entries read ahead point into DIRECTORY.  */
+  read_ahead_cancel ();
+}
+
 /* Copy info from the directory identified by ST into the archive.
-   DIRECTORY contains the directory's entries.  */
+   DIRECTORY contains the directory's entries, or is null if they are
+   to be read in batches while the directory is archived.  */
 
 static void
 dump_dir0 (struct tar_stat_info *st, char const *directory)
@@ -1217,6 +1702,7 @@ dump_dir0 (struct tar_stat_info *st, char const *directory)
     {
       char *name_buf;
       size_t name_size;
+      uintmax_t serial;
 
       switch (check_exclusion_tags (st, &tag_file_name))
 	{
@@ -1225,30 +1711,34 @@ dump_dir0 (struct tar_stat_info *st, char const *directory)
 	  break;
 
 	case exclusion_tag_none:
-	  {
-	    char const *entry;
-	    size_t entry_len;
-	    size_t name_len;
+	  name_buf = xstrdup (st->orig_file_name);
+	  name_size = strlen (name_buf);
+	  serial = ++read_ahead_dir_serial;
 
-	    name_buf = xstrdup (st->orig_file_name);
-	    name_size = name_len = strlen (name_buf);
+	  /* Entries of the parent directory are read ahead again when
+	     tar returns to it.  */
+	  read_ahead_cancel ();
 
-	    /* Now output all the files in the directory.  */
-	    for (entry = directory; (entry_len = strlen (entry)) != 0;
-		 entry += entry_len + 1)
-	      {
-		if (name_size < name_len + entry_len)
-		  {
-		    name_size = name_len + entry_len;
-		    name_buf = xrealloc (name_buf, name_size + 1);
-		  }
-		strcpy (name_buf + name_len, entry);
-		if (!excluded_name (name_buf, st))
-		  dump_file (st, entry, name_buf);
-	      }
+	  /* Now output all the files in the directory.  */
+	  if (directory)
+	    dump_dir_entries (st, serial, directory, &name_buf, &name_size);
+	  else
+	    {
+	      /* The directory is streamed: archive its entries a batch at
+		 a time, as they are read.  */
+	      char *batch;
 
-	    free (name_buf);
-	  }
+	      while ((batch = read_directory_batch (st)) && *batch)
+		{
+		  dump_dir_entries (st, serial, batch, &name_buf, &name_size);
+		  free (batch);
+		}
+	      if (batch)
+		free (batch);
+	      else
+		savedir_diag (st->orig_file_name);
+	    }
+	  free (name_buf);
 	  break;
 
 	case exclusion_tag_contents:
@@ -1303,6 +1793,13 @@ open_failure_recover (struct tar_stat_info const *dir)
       for (p = dir->parent->parent; p; p = p->parent)
 	if (0 < p->fd && (! p->parent || p->parent->fd <= 0))
 	  {
+	    /* Save the entries of a streamed directory that are still
+	       to be read, as its stream cannot be reopened where it
+	       was.  */
+	    if (p->dirstreamed && p->dirstream
+		&& ! (p->dirrest = streamsavedir (p->dirstream,
+						 SAVEDIR_SORT_NONE)))
+	      break;
 	    tar_stat_close (p);
 	    return true;
 	  }
@@ -1312,16 +1809,81 @@ open_failure_recover (struct tar_stat_info const *dir)
   return false;
 }
 
+/* A directory entry, for sorting by the location of its data.  */
+struct extent_entry
+{
+  char const *name;
+  off_t offset;			/* Physical location of the data */
+  size_t index;			/* Position in the directory */
+};
+
+static int
+compare_extent_entries (void const *a, void const *b)
+{
+  struct extent_entry const *ea = a;
+  struct extent_entry const *eb = b;
+
+  if (ea->offset != eb->offset)
+    return ea->offset < eb->offset ? -1 : 1;
+  return ea->index < eb->index ? -1 : ea->index > eb->index;
+}
+
+/* Reorder the entries of the directory ST listed in DIRECTORY, in the
+   format of get_directory_entries, by the location of their data on
+   disk, for --sort=extent.  Entries whose data has no known location,
+   such as subdirectories, come first in their original order.  */
+static void
+sort_by_extent (struct tar_stat_info const *st, char *directory)
+{
+  struct extent_entry *entries = NULL;
+  size_t allocated = 0;
+  size_t count = 0;
+  size_t size;
+  char *sorted;
+  char *p;
+  size_t i;
+
+  for (p = directory; *p; p += strlen (p) + 1)
+    {
+      if (count == allocated)
+	entries = x2nrealloc (entries, &allocated, sizeof *entries);
+      entries[count].name = p;
+      if (! sys_file_extent (st->fd, p, &entries[count].offset))
+	entries[count].offset = -1;
+      entries[count].index = count;
+      count++;
+    }
+  if (count < 2)
+    {
+      free (entries);
+      return;
+    }
+
+  qsort (entries, count, sizeof *entries, compare_extent_entries);
+  size = p - directory;
+  sorted = xmalloc (size);
+  for (p = sorted, i = 0; i < count; i++)
+    p = stpcpy (p, entries[i].name) + 1;
+  memcpy (directory, sorted, size);
+  free (sorted);
+  free (entries);
+}
+
 /* Return the directory entries of ST, in a dynamically allocated buffer,
    each entry followed by '\0' and the last followed by an extra '\0'.
    Return null on failure, setting errno.  */
 char *
 get_directory_entries (struct tar_stat_info *st)
 {
+  char *directory;
+
   while (! (st->dirstream = fdopendir (st->fd)))
     if (! open_failure_recover (st))
       return 0;
-  return streamsavedir (st->dirstream, savedir_sort_order);
+  directory = streamsavedir (st->dirstream, savedir_sort_order);
+  if (directory && sort_extent_option)
+    sort_by_extent (st, directory);
+  return directory;
 }
 
 /* Dump the directory ST.  Return true if successful, false (emitting
@@ -1330,7 +1892,29 @@ get_directory_entries (struct tar_stat_info *st)
 static bool
 dump_dir (struct tar_stat_info *st)
 {
-  char *directory = get_directory_entries (st);
+  char *directory;
+
+  /* Unless the entries are to be sorted, or are needed as a whole for
+     an incremental dump, archive them as they are read, so that huge
+     directories need not be held in memory.  Entries that are removed
+     while the directory is read might make it skip others, so not with
+     --remove-files.  */
+  if (savedir_sort_order == SAVEDIR_SORT_NONE && !sort_extent_option
+      && !incremental_option && !remove_files_option)
+    {
+      while (! (st->dirstream = fdopendir (st->fd)))
+	if (! open_failure_recover (st))
+	  {
+	    savedir_diag (st->orig_file_name);
+	    return false;
+	  }
+      st->dirstreamed = true;
+      dump_dir0 (st, NULL);
+      restore_parent_fd (st);
+      return true;
+    }
+
+  directory = get_directory_entries (st);
   if (! directory)
     {
       savedir_diag (st->orig_file_name);
@@ -1360,6 +1944,9 @@ create_archive (void)
 
   trivial_link_count = name_count <= 1 && ! dereference_option;
 
+  if (create_index_option || embed_index_option)
+    index_create_start ();
+
   open_archive (ACCESS_WRITE);
   buffer_write_global_xheader ();
 
@@ -1438,11 +2025,15 @@ create_archive (void)
 	  dump_file (0, name, name);
     }
 
+  finish_read_ahead ();
+  if (embed_index_option)
+    index_embed ();
   write_eot ();
   close_archive ();
   finish_deferred_unlinks ();
   if (listed_incremental_option)
     write_directory_file ();
+  index_create_finish ();
 }
 
 
@@ -1479,9 +2070,67 @@ unknown_file_error (char const *p)
 
 /* Table of all non-directories that we've written so far.  Any time
    we see another, we check the table and avoid dumping the data
-   again if we've done it once already.  */
+   again if we've done it once already.  A file is dropped from the
+   table once all its links have been seen.  */
 static Hash_table *link_table;
 
+/* Temporary file holding the names of the files in link_table, if
+   --spill-link-names is given.  */
+static FILE *link_name_file;
+
+/* Return the name of LP.  It is valid until the next call.  */
+static char const *
+link_name_of (struct link const *lp)
+{
+  static char *buf;
+  static size_t bufsize;
+
+  if (lp->name_offset < 0)
+    return lp->name;
+
+  if (bufsize < lp->name_size)
+    {
+      bufsize = lp->name_size;
+      buf = xrealloc (buf, bufsize);
+    }
+  if (fseeko (link_name_file, lp->name_offset, SEEK_SET) != 0
+      || fread (buf, 1, lp->name_size, link_name_file) != lp->name_size)
+    FATAL_ERROR ((0, errno, _("Cannot read temporary file")));
+  return buf;
+}
+
+/* Allocate an entry for link_table named NAME.  */
+static struct link *
+link_alloc (char const *name)
+{
+  struct link *lp;
+  size_t size = strlen (name) + 1;
+
+  if (! spill_link_names_option)
+    {
+      lp = xmalloc (offsetof (struct link, name) + size);
+      lp->name_offset = -1;
+      memcpy (lp->name, name, size);
+      return lp;
+    }
+
+  if (! link_name_file)
+    {
+      link_name_file = tmpfile ();
+      if (! link_name_file)
+	FATAL_ERROR ((0, errno, _("Cannot create temporary file")));
+    }
+
+  lp = xmalloc (sizeof *lp);
+  lp->name[0] = '\0';
+  lp->name_size = size;
+  if (fseeko (link_name_file, 0, SEEK_END) != 0
+      || (lp->name_offset = ftello (link_name_file)) < 0
+      || fwrite (name, 1, size, link_name_file) != size)
+    FATAL_ERROR ((0, errno, _("Cannot write temporary file")));
+  return lp;
+}
+
 /* Try to dump stat as a hard link to another file in the archive.
    Return true if successful.  */
 static bool
@@ -1501,8 +2150,9 @@ dump_hard_link (struct tar_stat_info *st)
       if ((duplicate = hash_lookup (link_table, &lp)))
 	{
 	  /* We found a link.  */
-	  char const *link_name = safer_name_suffix (duplicate->name, true,
-	                                             absolute_names_option);
+	  char const *link_name = safer_name_suffix (link_name_of (duplicate),
+						     true,
+						     absolute_names_option);
 	  if (duplicate->nlink)
 	    duplicate->nlink--;
 
@@ -1524,6 +2174,15 @@ dump_hard_link (struct tar_stat_info *st)
 	  if (remove_files_option)
 	    queue_deferred_unlink (st->orig_file_name, false);
 
+	  /* Unless the file can be met again under another name given
+	     on the command line or through a symbolic link, no links to
+	     it remain to be seen.  */
+	  if (! duplicate->nlink && trivial_link_count)
+	    {
+	      hash_delete (link_table, duplicate);
+	      free (duplicate);
+	    }
+
 	  return true;
 	}
     }
@@ -1544,12 +2203,10 @@ file_count_links (struct tar_stat_info *st)
       assign_string (&linkname, st->orig_file_name);
       transform_name (&linkname, XFORM_LINK);
 
-      lp = xmalloc (offsetof (struct link, name)
-				 + strlen (linkname) + 1);
+      lp = link_alloc (linkname);
       lp->ino = st->stat.st_ino;
       lp->dev = st->stat.st_dev;
       lp->nlink = st->stat.st_nlink;
-      strcpy (lp->name, linkname);
       free (linkname);
 
       if (! ((link_table
@@ -1579,7 +2236,7 @@ check_links (void)
     {
       if (lp->nlink)
 	{
-	  WARN ((0, 0, _("Missing links to %s."), quote (lp->name)));
+	  WARN ((0, 0, _("Missing links to %s."), quote (link_name_of (lp))));
 	}
     }
 }
@@ -1674,6 +2331,9 @@ dump_file0 (struct tar_stat_info *st, char const *name, char const *p)
   bool top_level = ! parent;
   int parentfd = top_level ? chdir_fd : parent->fd;
   void (*diag) (char const *) = 0;
+  struct read_ahead_entry *looked_up = read_ahead_result;
+
+  read_ahead_result = NULL;
 
   if (interactive_option && !confirm ("add", p))
     return;
@@ -1689,6 +2349,16 @@ dump_file0 (struct tar_stat_info *st, char const *name, char const *p)
       errno = - parentfd;
       diag = open_diag;
     }
+  else if (looked_up && looked_up->reply.found)
+    {
+      /* Use what was found when the entry was read ahead.  */
+      st->stat = looked_up->reply.stat;
+      if (0 <= looked_up->fd)
+	{
+	  fd = st->fd = looked_up->fd;
+	  looked_up->fd = -1;
+	}
+    }
   else if (fstatat (parentfd, name, &st->stat, fstatat_flags) != 0)
     diag = stat_diag;
   else if (file_dumpable_p (&st->stat))
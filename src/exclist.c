@@ -20,6 +20,7 @@
 #include <system.h>
 #include <quotearg.h>
 #include <fnmatch.h>
+#include <hash.h>
 #include <wordsplit.h>
 #include "common.h"
 
@@ -66,14 +67,25 @@ struct exclist
   struct exclude *excluded;
 };
 
+/* Return true if some list in LIST applies to subdirectories.  */
+static bool
+exclist_recursive (struct exclist const *list)
+{
+  for (; list; list = list->next)
+    if (! (list->flags & EXCL_NON_RECURSIVE))
+      return true;
+  return false;
+}
+
 void
 info_attach_exclist (struct tar_stat_info *dir)
 {
   struct excfile *file;
   struct exclist *head = NULL, *tail = NULL, *ent;
   struct vcs_ignore_file *vcsfile;
+  struct tar_stat_info *parent;
 
-  if (dir->exclude_list)
+  if (dir->exclude_list_attached)
     return;
   for (file = excfile_head; file; file = file->next)
     {
@@ -127,6 +139,26 @@ info_attach_exclist (struct tar_stat_info *dir)
 	}
     }
   dir->exclude_list = head;
+  dir->exclude_list_attached = true;
+
+  /* Remember where the lists inherited by this directory are, so that
+     excluded_name need not walk through the ancestors that have
+     none.  */
+  dir->exclude_parent = NULL;
+  for (parent = dir->parent; parent; parent = parent->parent)
+    {
+      if (parent->exclude_list_attached)
+	{
+	  dir->exclude_parent = (exclist_recursive (parent->exclude_list)
+				 ? parent : parent->exclude_parent);
+	  break;
+	}
+      if (exclist_recursive (parent->exclude_list))
+	{
+	  dir->exclude_parent = parent;
+	  break;
+	}
+    }
 }
 
 void
@@ -143,8 +175,256 @@ info_free_exclist (struct tar_stat_info *dir)
     }
 
   dir->exclude_list = NULL;
+  dir->exclude_list_attached = false;
+}
+
+
+/* Wildcard patterns of the global exclusion list, kept here rather
+   than in EXCLUDED so that they can be indexed.  Once there are at
+   least PATTERN_INDEX_MIN of them, they are indexed by the longer of
+   the literal texts that start and end them.  A pattern like "*.o" can
+   only match a file name, or with FNM_LEADING_DIR one of its leading
+   directories, that ends with ".o"; a pattern like "core.*" can only
+   match a file name, or one of its trailing parts if it is not
+   anchored, that starts with "core.".  Their last or first (at most
+   PATTERN_KEY_MAX) bytes are the keys of pattern_tails and
+   pattern_heads, which map them to the patterns that may match.  */
+
+enum { PATTERN_INDEX_MIN = 16, PATTERN_KEY_MAX = 3 };
+
+struct indexed_pattern
+{
+  char *pattern;
+  int options;
+};
+
+/* Patterns filed under the KEY_LEN bytes at KEY.  PATTERN holds the
+   indices of the COUNT of them in indexed_patterns.  */
+struct pattern_key
+{
+  char const *key;
+  size_t key_len;
+  size_t *pattern;
+  size_t count;
+  size_t alloc;
+};
+
+static struct indexed_pattern *indexed_patterns;
+static size_t indexed_pattern_count;
+static size_t indexed_pattern_alloc;
+
+/* Number of patterns filed in pattern_heads and pattern_tails.  */
+static size_t indexed_pattern_filed;
+
+static Hash_table *pattern_heads;
+static Hash_table *pattern_tails;
+
+static size_t
+pattern_key_hasher (void const *data, size_t n_buckets)
+{
+  struct pattern_key const *key = data;
+  size_t value = 0;
+  size_t i;
+
+  for (i = 0; i < key->key_len; i++)
+    value = (value * 31 + (unsigned char) key->key[i]) % n_buckets;
+  return value;
+}
+
+static bool
+pattern_key_compare (void const *data1, void const *data2)
+{
+  struct pattern_key const *key1 = data1;
+  struct pattern_key const *key2 = data2;
+  return (key1->key_len == key2->key_len
+	  && memcmp (key1->key, key2->key, key1->key_len) == 0);
+}
+
+static void
+pattern_key_free (void *data)
+{
+  struct pattern_key *key = data;
+  free (key->pattern);
+  free (key);
+}
+
+/* Return true if C is special in a wildcard pattern.  */
+static bool
+wildcard_special (char c)
+{
+  return strchr ("*?[]\\", c) != NULL;
+}
+
+/* Return the length of the literal text that starts PATTERN, and set
+   *TAIL to that of the text that ends it.  */
+static size_t
+pattern_literal_ends (char const *pattern, size_t *tail)
+{
+  size_t len = strlen (pattern);
+  size_t head;
+
+  for (head = 0; head < len && ! wildcard_special (pattern[head]); head++)
+    continue;
+  for (*tail = 0; *tail < len && ! wildcard_special (pattern[len - *tail - 1]);
+       ++*tail)
+    continue;
+  return head;
+}
+
+/* File the pattern with index I in TABLE, under the KEY_LEN bytes at
+   KEY.  */
+static void
+file_pattern_key (Hash_table *table, char const *key, size_t key_len,
+		  size_t i)
+{
+  struct pattern_key probe;
+  struct pattern_key *ent;
+
+  probe.key = key;
+  probe.key_len = key_len;
+  ent = hash_lookup (table, &probe);
+  if (! ent)
+    {
+      ent = xzalloc (sizeof *ent);
+      ent->key = key;
+      ent->key_len = key_len;
+      if (! hash_insert (table, ent))
+	xalloc_die ();
+    }
+  if (ent->count == ent->alloc)
+    ent->pattern = x2nrealloc (ent->pattern, &ent->alloc,
+			       sizeof *ent->pattern);
+  ent->pattern[ent->count++] = i;
+}
+
+/* File the patterns added since the last call.  */
+static void
+file_indexed_patterns (void)
+{
+  size_t i;
+
+  if (! pattern_heads)
+    {
+      pattern_heads = hash_initialize (0, NULL, pattern_key_hasher,
+				       pattern_key_compare, pattern_key_free);
+      pattern_tails = hash_initialize (0, NULL, pattern_key_hasher,
+				       pattern_key_compare, pattern_key_free);
+      if (! (pattern_heads && pattern_tails))
+	xalloc_die ();
+    }
+
+  for (i = indexed_pattern_filed; i < indexed_pattern_count; i++)
+    {
+      char const *pattern = indexed_patterns[i].pattern;
+      size_t tail;
+      size_t head = pattern_literal_ends (pattern, &tail);
+
+      if (head <= tail)
+	file_pattern_key (pattern_tails,
+			  pattern + strlen (pattern) - min (tail, PATTERN_KEY_MAX),
+			  min (tail, PATTERN_KEY_MAX), i);
+      else
+	file_pattern_key (pattern_heads, pattern,
+			  min (head, PATTERN_KEY_MAX), i);
+    }
+  indexed_pattern_filed = indexed_pattern_count;
+}
+
+/* Add PATTERN with OPTIONS to the global exclusion list EX, as
+   add_exclude does.  Wildcard patterns that have a literal head or
+   tail are kept aside to be indexed.  As the global list holds no
+   EXCLUDE_INCLUDE patterns, a name is excluded if any pattern matches,
+   whichever list the pattern is in.  */
+void
+add_exclude_indexed (struct exclude *ex, char const *pattern, int options)
+{
+  size_t head, tail;
+
+  if (! (options & EXCLUDE_WILDCARDS)
+      || (options & (EXCLUDE_REGEX | EXCLUDE_INCLUDE
+		     | FNM_CASEFOLD | FNM_EXTMATCH))
+      || ! fnmatch_pattern_has_wildcards (pattern, options))
+    {
+      add_exclude (ex, pattern, options);
+      return;
+    }
+  head = pattern_literal_ends (pattern, &tail);
+  if (head == 0 && tail == 0)
+    {
+      add_exclude (ex, pattern, options);
+      return;
+    }
+
+  if (indexed_pattern_count == indexed_pattern_alloc)
+    indexed_patterns = x2nrealloc (indexed_patterns, &indexed_pattern_alloc,
+				   sizeof *indexed_patterns);
+  indexed_patterns[indexed_pattern_count].pattern = xstrdup (pattern);
+  indexed_patterns[indexed_pattern_count].options = options;
+  indexed_pattern_count++;
 }
 
+/* Return true if one of the patterns in TABLE whose key ends at
+   NAME + POS (or, if HEAD, starts there) matches NAME, whose length is
+   LEN.  */
+static bool
+keyed_patterns_match (Hash_table *table, bool head,
+		      char const *name, size_t len, size_t pos)
+{
+  struct pattern_key probe;
+  size_t i;
+
+  for (probe.key_len = 1; probe.key_len <= PATTERN_KEY_MAX; probe.key_len++)
+    {
+      struct pattern_key const *ent;
+
+      if (head ? len - pos < probe.key_len : pos < probe.key_len)
+	break;
+      probe.key = head ? name + pos : name + pos - probe.key_len;
+      ent = hash_lookup (table, &probe);
+      if (ent)
+	for (i = 0; i < ent->count; i++)
+	  {
+	    struct indexed_pattern const *p = &indexed_patterns[ent->pattern[i]];
+	    if (exclude_fnmatch (p->pattern, name, p->options))
+	      return true;
+	  }
+    }
+  return false;
+}
+
+/* Return true if one of the patterns kept by add_exclude_indexed
+   matches NAME.  */
+static bool
+indexed_patterns_match (char const *name)
+{
+  size_t i, len;
+
+  if (indexed_pattern_count < PATTERN_INDEX_MIN)
+    {
+      for (i = 0; i < indexed_pattern_count; i++)
+	if (exclude_fnmatch (indexed_patterns[i].pattern, name,
+			     indexed_patterns[i].options))
+	  return true;
+      return false;
+    }
+
+  if (indexed_pattern_filed != indexed_pattern_count)
+    file_indexed_patterns ();
+
+  /* A pattern matches NAME only if its literal tail ends where NAME or
+     one of its leading directories does, and if its literal head
+     starts where NAME or one of its trailing parts does.  */
+  len = strlen (name);
+  for (i = 0; i <= len; i++)
+    if (i == len || name[i] == '/')
+      {
+	if (keyed_patterns_match (pattern_tails, false, name, len, i)
+	    || (i < len
+		&& keyed_patterns_match (pattern_heads, true, name, len, i + 1)))
+	  return true;
+      }
+  return keyed_patterns_match (pattern_heads, true, name, len, 0);
+}
 
 /* Return nonzero if file NAME is excluded.  */
 bool
@@ -159,13 +439,15 @@ excluded_name (char const *name, struct tar_stat_info *st)
   name += FILE_SYSTEM_PREFIX_LEN (name);
 
   /* Try global exclusion list first */
-  if (excluded_file_name (excluded, name))
+  if (excluded_file_name (excluded, name) || indexed_patterns_match (name))
     return true;
 
   if (!st)
     return false;
 
-  for (result = false; st && !result; st = st->parent, nr = EXCL_NON_RECURSIVE)
+  for (result = false; st && !result;
+       st = (st->exclude_list_attached ? st->exclude_parent : st->parent),
+	 nr = EXCL_NON_RECURSIVE)
     {
       for (ep = st->exclude_list; ep; ep = ep->next)
 	{
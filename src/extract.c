@@ -26,6 +26,7 @@
 #include <priv-set.h>
 #include <root-uid.h>
 #include <utimens.h>
+#include <hash.h>
 
 #include "common.h"
 
@@ -63,8 +64,13 @@ implemented (int err)
 
 struct delayed_set_stat
   {
-    /* Next directory in list.  */
+    /* Next and previous directories in list.  */
     struct delayed_set_stat *next;
+    struct delayed_set_stat *prev;
+
+    /* An older directory in the list with the same name, which this
+       one hides in delayed_set_stat_table.  */
+    struct delayed_set_stat *older;
 
     /* Metadata for this directory.  */
     dev_t dev;
@@ -114,6 +120,10 @@ struct delayed_set_stat
 
 static struct delayed_set_stat *delayed_set_stat_head;
 
+/* The entries of delayed_set_stat_head, indexed by working directory
+   and name.  Only the most recent entry for a name is in the table.  */
+static Hash_table *delayed_set_stat_table;
+
 /* List of links whose creation we have delayed.  */
 struct delayed_link
   {
@@ -165,6 +175,10 @@ struct delayed_link
 
 static struct delayed_link *delayed_link_head;
 
+/* The entries of delayed_link_head, indexed by the placeholder's
+   device and inode number.  */
+static Hash_table *delayed_link_table;
+
 struct string_list
   {
     struct string_list *next;
@@ -417,6 +431,90 @@ mark_after_links (struct delayed_set_stat *head)
   while ((h = h->next) && ! h->after_links);
 }
 
+static size_t
+delayed_set_stat_hash (void const *entry, size_t n_buckets)
+{
+  struct delayed_set_stat const *data = entry;
+  return ((hash_string (data->file_name, n_buckets) + data->change_dir)
+	  % n_buckets);
+}
+
+static bool
+delayed_set_stat_compare (void const *entry1, void const *entry2)
+{
+  struct delayed_set_stat const *data1 = entry1;
+  struct delayed_set_stat const *data2 = entry2;
+  return (data1->change_dir == data2->change_dir
+	  && data1->file_name_len == data2->file_name_len
+	  && strcmp (data1->file_name, data2->file_name) == 0);
+}
+
+/* Return the most recent entry for the directory FILE_NAME, or NULL if
+   there is none.  */
+static struct delayed_set_stat *
+find_delayed_set_stat (char const *file_name)
+{
+  struct delayed_set_stat key;
+
+  if (! delayed_set_stat_table)
+    return NULL;
+  key.change_dir = chdir_current;
+  key.file_name_len = strlen (file_name);
+  key.file_name = (char *) file_name;
+  return hash_lookup (delayed_set_stat_table, &key);
+}
+
+/* Enter DATA into delayed_set_stat_table, hiding any older entry with
+   the same name.  */
+static void
+hash_delayed_set_stat (struct delayed_set_stat *data)
+{
+  void const *older;
+  int r;
+
+  if (! delayed_set_stat_table)
+    {
+      delayed_set_stat_table = hash_initialize (0, 0, delayed_set_stat_hash,
+						delayed_set_stat_compare, NULL);
+      if (! delayed_set_stat_table)
+	xalloc_die ();
+    }
+
+  r = hash_insert_if_absent (delayed_set_stat_table, data, &older);
+  if (r == 0)
+    {
+      data->older = hash_delete (delayed_set_stat_table, older);
+      r = hash_insert_if_absent (delayed_set_stat_table, data, NULL);
+    }
+  if (r < 0)
+    xalloc_die ();
+}
+
+/* Remove DATA from delayed_set_stat_table, or from the entries hidden
+   by another one, bringing back the entry it hides.  */
+static void
+unhash_delayed_set_stat (struct delayed_set_stat *data)
+{
+  struct delayed_set_stat *newer = hash_lookup (delayed_set_stat_table, data);
+
+  if (newer == data)
+    {
+      hash_delete (delayed_set_stat_table, data);
+      if (data->older
+	  && hash_insert_if_absent (delayed_set_stat_table, data->older,
+				    NULL) < 0)
+	xalloc_die ();
+    }
+  else
+    {
+      while (newer && newer->older != data)
+	newer = newer->older;
+      if (newer)
+	newer->older = data->older;
+    }
+  data->older = NULL;
+}
+
 /* Remember to restore stat attributes (owner, group, mode and times)
    for the directory FILE_NAME, using information given in *ST,
    once we stop extracting files into that directory.
@@ -443,6 +541,8 @@ delay_set_stat (char const *file_name, struct tar_stat_info const *st,
   size_t file_name_len = strlen (file_name);
   struct delayed_set_stat *data = xmalloc (sizeof (*data));
   data->next = delayed_set_stat_head;
+  data->prev = NULL;
+  data->older = NULL;
   data->mode = mode;
   if (st)
     {
@@ -492,7 +592,10 @@ delay_set_stat (char const *file_name, struct tar_stat_info const *st,
       data->xattr_map_size = 0;
     }
   strcpy (data->file_name, file_name);
+  if (delayed_set_stat_head)
+    delayed_set_stat_head->prev = data;
   delayed_set_stat_head = data;
+  hash_delayed_set_stat (data);
   if (must_be_dot_or_slash (file_name))
     mark_after_links (data);
 }
@@ -536,9 +639,18 @@ repair_delayed_set_stat (char const *dir,
 	  quotearg_colon (dir)));
 }
 
+/* Remove DATA from the list of delayed directories and free it.  */
 static void
 free_delayed_set_stat (struct delayed_set_stat *data)
 {
+  unhash_delayed_set_stat (data);
+  if (data->prev)
+    data->prev->next = data->next;
+  else
+    delayed_set_stat_head = data->next;
+  if (data->next)
+    data->next->prev = data->prev;
+
   free (data->file_name);
   xheader_xattr_free (data->xattr_map, data->xattr_map_size);
   free (data->cntx_name);
@@ -550,40 +662,282 @@ free_delayed_set_stat (struct delayed_set_stat *data)
 void
 remove_delayed_set_stat (const char *fname)
 {
-  struct delayed_set_stat *data, *next, *prev = NULL;
-  for (data = delayed_set_stat_head; data; data = next)
+  struct delayed_set_stat *data = find_delayed_set_stat (fname);
+  if (data)
+    free_delayed_set_stat (data);
+}
+
+static void
+fixup_delayed_set_stat (char const *src, char const *dst)
+{
+  struct delayed_set_stat *data = find_delayed_set_stat (src);
+  if (data)
     {
-      next = data->next;
-      if (chdir_current == data->change_dir
-	  && strcmp (data->file_name, fname) == 0)
-	{
-	  free_delayed_set_stat (data);
-	  if (prev)
-	    prev->next = next;
-	  else
-	    delayed_set_stat_head = next;
-	  return;
-	}
-      else
-	prev = data;
+      unhash_delayed_set_stat (data);
+      free (data->file_name);
+      data->file_name = xstrdup (dst);
+      data->file_name_len = strlen (dst);
+      hash_delayed_set_stat (data);
     }
 }
 
+/* Directories in which members were recently extracted, kept open so
+   that each member's name is resolved from its parent directory rather
+   than from the working directory, component by component.  The most
+   recently used directory comes first.  Names are relative to the
+   working directory CHANGE_DIR.  */
+struct dir_fd
+{
+  int change_dir;
+  int fd;
+  size_t name_len;
+  char *name;
+};
+
+/* Maximum number of directories kept open.  */
+enum { DIR_FD_CACHE_SIZE = 16 };
+
+static struct dir_fd dir_fd_cache[DIR_FD_CACHE_SIZE];
+static size_t dir_fd_cached;
+
+/* Number of directories that may be kept open.  It is lowered when
+   descriptors run out.  */
+static size_t dir_fd_cache_max = DIR_FD_CACHE_SIZE;
+
 static void
-fixup_delayed_set_stat (char const *src, char const *dst)
+dir_fd_close (size_t i)
 {
-  struct delayed_set_stat *data;
-  for (data = delayed_set_stat_head; data; data = data->next)
+  close (dir_fd_cache[i].fd);
+  free (dir_fd_cache[i].name);
+  dir_fd_cached--;
+  memmove (&dir_fd_cache[i], &dir_fd_cache[i + 1],
+	   (dir_fd_cached - i) * sizeof *dir_fd_cache);
+}
+
+/* Close the directories FILE_NAME and those below it, which are being
+   removed or made anew.  */
+static void
+forget_dir_fds (char const *file_name)
+{
+  size_t len = strlen (file_name);
+  size_t i;
+
+  for (i = 0; i < dir_fd_cached; )
+    if (dir_fd_cache[i].change_dir == chdir_current
+	&& len <= dir_fd_cache[i].name_len
+	&& memcmp (dir_fd_cache[i].name, file_name, len) == 0
+	&& (len == dir_fd_cache[i].name_len
+	    || ISSLASH (dir_fd_cache[i].name[len])))
+      dir_fd_close (i);
+    else
+      i++;
+}
+
+static void
+forget_all_dir_fds (void)
+{
+  while (dir_fd_cached)
+    dir_fd_close (dir_fd_cached - 1);
+}
+
+/* Return a descriptor through which FILE_NAME can be reached, and set
+   *BASE to its name relative to that descriptor.  This is its parent
+   directory and last component, if the parent can be opened, and
+   CHDIR_FD and FILE_NAME otherwise.  */
+static int
+parent_dir_fd (char const *file_name, char const **base)
+{
+  char const *slash = strrchr (file_name, '/');
+  size_t len;
+  size_t i;
+  char *name;
+  int fd;
+
+  *base = file_name;
+  if (! slash || slash == file_name || ! slash[1] || ! dir_fd_cache_max)
+    return chdir_fd;
+  len = slash - file_name;
+
+  for (i = 0; i < dir_fd_cached; i++)
+    if (dir_fd_cache[i].change_dir == chdir_current
+	&& dir_fd_cache[i].name_len == len
+	&& memcmp (dir_fd_cache[i].name, file_name, len) == 0)
+      {
+	struct dir_fd d = dir_fd_cache[i];
+	memmove (&dir_fd_cache[1], &dir_fd_cache[0], i * sizeof *dir_fd_cache);
+	dir_fd_cache[0] = d;
+	*base = slash + 1;
+	return d.fd;
+      }
+
+  name = xmalloc (len + 1);
+  memcpy (name, file_name, len);
+  name[len] = '\0';
+  while ((fd = openat (chdir_fd, name,
+		       (O_SEARCH | O_DIRECTORY | O_CLOEXEC | O_NOCTTY
+			| O_NONBLOCK)))
+	 < 0
+	 && errno == EMFILE && dir_fd_cached)
     {
-      if (chdir_current == data->change_dir
-	  && strcmp (data->file_name, src) == 0)
-	{
-	  free (data->file_name);
-	  data->file_name = xstrdup (dst);
-	  data->file_name_len = strlen (dst);
-	  return;
-	}
+      dir_fd_close (dir_fd_cached - 1);
+      dir_fd_cache_max = dir_fd_cached;
+    }
+  if (fd < 0 || ! dir_fd_cache_max)
+    {
+      if (0 <= fd)
+	close (fd);
+      free (name);
+      return chdir_fd;
+    }
+
+  if (dir_fd_cached == dir_fd_cache_max)
+    dir_fd_close (dir_fd_cached - 1);
+  memmove (&dir_fd_cache[1], &dir_fd_cache[0],
+	   dir_fd_cached * sizeof *dir_fd_cache);
+  dir_fd_cache[0].change_dir = chdir_current;
+  dir_fd_cache[0].fd = fd;
+  dir_fd_cache[0].name_len = len;
+  dir_fd_cache[0].name = name;
+  dir_fd_cached++;
+  *base = slash + 1;
+  return fd;
+}
+
+/* Directories known to exist, either because tar made them or because
+   it found them while extracting.  make_directories consults them so
+   as not to attempt making the ancestors of every extracted file again.
+   Names are relative to the working directory CHANGE_DIR.  */
+struct known_dir
+{
+  int change_dir;
+  char *file_name;
+};
+
+static Hash_table *known_dir_table;
+
+static size_t
+known_dir_hash (void const *entry, size_t n_buckets)
+{
+  struct known_dir const *d = entry;
+  return (hash_string (d->file_name, n_buckets) + d->change_dir) % n_buckets;
+}
+
+static bool
+known_dir_compare (void const *entry1, void const *entry2)
+{
+  struct known_dir const *d1 = entry1;
+  struct known_dir const *d2 = entry2;
+  return (d1->change_dir == d2->change_dir
+	  && strcmp (d1->file_name, d2->file_name) == 0);
+}
+
+static void
+known_dir_free (void *entry)
+{
+  struct known_dir *d = entry;
+  free (d->file_name);
+  free (d);
+}
+
+/* Return true if the directory FILE_NAME is known to exist.  */
+static bool
+known_dir_p (char const *file_name)
+{
+  struct known_dir key;
+
+  if (! known_dir_table)
+    return false;
+  key.change_dir = chdir_current;
+  key.file_name = (char *) file_name;
+  return hash_lookup (known_dir_table, &key) != NULL;
+}
+
+/* Record that the directory FILE_NAME exists.  */
+static void
+known_dir_add (char const *file_name)
+{
+  struct known_dir *d;
+
+  if (known_dir_p (file_name))
+    return;
+  if (! known_dir_table)
+    {
+      known_dir_table = hash_initialize (0, 0, known_dir_hash,
+					 known_dir_compare, known_dir_free);
+      if (! known_dir_table)
+	xalloc_die ();
     }
+  d = xmalloc (sizeof *d);
+  d->change_dir = chdir_current;
+  d->file_name = xstrdup (file_name);
+  if (! hash_insert (known_dir_table, d))
+    xalloc_die ();
+}
+
+/* Record that the parent directory of FILE_NAME, if it is given,
+   exists.  */
+static void
+known_dir_add_parent (char *file_name)
+{
+  char *slash = strrchr (file_name, '/');
+
+  if (slash && slash != file_name)
+    {
+      *slash = '\0';
+      known_dir_add (file_name);
+      *slash = '/';
+    }
+}
+
+/* Forget about the directory FILE_NAME, which has been removed.  */
+void
+forget_known_directory (char const *file_name)
+{
+  struct known_dir key;
+  struct known_dir *d;
+
+  forget_dir_fds (file_name);
+  if (! known_dir_table)
+    return;
+  key.change_dir = chdir_current;
+  key.file_name = (char *) file_name;
+  d = hash_delete (known_dir_table, &key);
+  if (d)
+    known_dir_free (d);
+}
+
+/* Forget about all directories, e.g. because one of them was renamed.  */
+static void
+forget_known_directories (void)
+{
+  forget_all_dir_fds ();
+  if (known_dir_table)
+    hash_clear (known_dir_table);
+}
+
+/* Return the position in FILE_NAME from which make_directories should
+   look for missing directories: just past the longest leading
+   directory known to exist, or CURSOR0 if there is none.  */
+static char *
+known_dir_end (char *file_name, char *cursor0)
+{
+  char *cursor;
+
+  if (! known_dir_table)
+    return cursor0;
+
+  for (cursor = file_name + strlen (file_name); cursor0 < cursor; cursor--)
+    if (ISSLASH (*cursor) && ! ISSLASH (cursor[-1]))
+      {
+	bool known;
+
+	*cursor = '\0';
+	known = known_dir_p (file_name);
+	*cursor = '/';
+	if (known)
+	  return cursor + 1;
+      }
+  return cursor0;
 }
 
 /* After a file/link/directory creation has failed, see if
@@ -595,9 +949,12 @@ static int
 make_directories (char *file_name, bool *interdir_made)
 {
   char *cursor0 = file_name + FILE_SYSTEM_PREFIX_LEN (file_name);
+  char *start = known_dir_end (file_name, cursor0);
   char *cursor;	        	/* points into the file name */
+  bool made = false;
 
-  for (cursor = cursor0; *cursor; cursor++)
+ again:
+  for (cursor = start; *cursor; cursor++)
     {
       mode_t mode;
       mode_t desired_mode;
@@ -634,7 +991,8 @@ make_directories (char *file_name, bool *interdir_made)
 			  desired_mode, AT_SYMLINK_NOFOLLOW);
 
 	  print_for_mkdir (file_name, cursor - file_name, desired_mode);
-	  *interdir_made = true;
+	  forget_dir_fds (file_name);
+	  *interdir_made = made = true;
 	}
       else if (errno == EEXIST)
 	status = 0;
@@ -654,11 +1012,23 @@ make_directories (char *file_name, bool *interdir_made)
 	    }
 	}
 
+      if (status == 0)
+	known_dir_add (file_name);
       *cursor = '/';
       if (status)
 	return status;
     }
 
+  /* If nothing was missing past the directories known to exist, one of
+     these may have been removed by another process.  Look again from
+     the start.  */
+  if (! made && start != cursor0)
+    {
+      forget_known_directories ();
+      start = cursor0;
+      goto again;
+    }
+
   return 0;
 }
 
@@ -894,7 +1264,6 @@ apply_nonancestor_delayed_set_stat (char const *file_name, bool after_links)
 		    DIRTYPE, data->interdir, data->atflag);
 	}
 
-      delayed_set_stat_head = data->next;
       free_delayed_set_stat (data);
     }
 }
@@ -959,12 +1328,25 @@ extract_dir (char *file_name, int typeflag)
 
   for (;;)
     {
-      status = mkdirat (chdir_fd, file_name, mode);
+      /* Don't try to make a directory that is known to exist.  */
+      if (known_dir_p (file_name))
+	{
+	  status = -1;
+	  errno = EEXIST;
+	}
+      else
+	{
+	  char const *base;
+	  int dirfd = parent_dir_fd (file_name, &base);
+	  status = mkdirat (dirfd, base, mode);
+	}
       if (status == 0)
 	{
 	  current_mode = mode & ~ current_umask;
 	  current_mode_mask = MODE_RWX;
 	  atflag = AT_SYMLINK_NOFOLLOW;
+	  forget_dir_fds (file_name);
+	  known_dir_add (file_name);
 	  break;
 	}
 
@@ -986,6 +1368,7 @@ extract_dir (char *file_name, int typeflag)
 
 	      if (S_ISDIR (current_mode))
 		{
+		  known_dir_add (file_name);
 		  if (interdir_made)
 		    {
 		      repair_delayed_set_stat (file_name, &st);
@@ -1033,6 +1416,8 @@ open_output_file (char const *file_name, int typeflag, mode_t mode,
                   mode_t *current_mode_mask)
 {
   int fd;
+  int dirfd;
+  char const *base;
   bool overwriting_old_files = old_files_option == OVERWRITE_OLD_FILES;
   int openflag = (O_WRONLY | O_BINARY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK
 		  | O_CREAT
@@ -1071,7 +1456,17 @@ open_output_file (char const *file_name, int typeflag, mode_t mode,
 	}
     }
 
-  fd = openat (chdir_fd, file_name, openflag, mode);
+  dirfd = parent_dir_fd (file_name, &base);
+  fd = openat (dirfd, base, openflag, mode);
+
+  /* Keep fewer directories open if they use up descriptors.  */
+  if (fd < 0 && errno == EMFILE && dir_fd_cached)
+    {
+      dir_fd_cache_max = dir_fd_cached / 2;
+      forget_all_dir_fds ();
+      fd = openat (chdir_fd, file_name, openflag, mode);
+    }
+
   if (0 <= fd)
     {
       if (overwriting_old_files)
@@ -1103,6 +1498,413 @@ open_output_file (char const *file_name, int typeflag, mode_t mode,
   return fd;
 }
 
+/* Parallel extraction of regular files.
+
+   With --extract-workers, the data of regular files is written by
+   child processes.  The main process creates each file as usual, and
+   then passes its descriptor to a worker, followed by the attributes
+   set_stat needs and the file data.  The worker writes the data,
+   restores the attributes through the descriptor and closes it.
+   Each worker handles its files in the order they were passed.
+   Directories, links and other members are still handled by the main
+   process, so delayed status setting and delayed links work exactly
+   as before; extract_finish waits for the workers before applying
+   them.
+
+   What is passed to a worker is collected in a batch, which is sent
+   in one go, along with the descriptors of the files it starts, when
+   it is full.  Extracting many small files thus costs the main process
+   a single send per batch rather than several per file.  */
+
+/* Number of bytes collected in a batch before it is sent, unless a
+   single item is larger.  */
+enum { EXTRACT_BATCH_SIZE = 64 * 1024 };
+
+/* Maximum number of files started in a batch.  */
+enum { EXTRACT_BATCH_FILES = SYS_FDS_MAX };
+
+/* Number of files started in a batch before it is sent.  The
+   descriptors of these files stay open in tar until then, so all the
+   workers together hold at most half of the files tar may open.  */
+static size_t extract_batch_files;
+
+/* Header of a batch.  It is followed by SIZE bytes of items, and
+   accompanied by FILES descriptors.  */
+struct extract_batch
+{
+  size_t size;
+  size_t files;
+};
+
+struct extract_worker
+{
+  pid_t pid;                    /* Process ID of the worker */
+  int sock;                     /* Socket used to pass it files */
+  char *batch;                  /* Batch being collected */
+  size_t batch_size;            /* Bytes allocated for it */
+  size_t batch_used;            /* Bytes used, including the header */
+  int fds[EXTRACT_BATCH_FILES]; /* Descriptors of files it starts */
+  char *names[EXTRACT_BATCH_FILES]; /* Names of these files */
+  size_t files;                 /* Number of these files */
+};
+
+static struct extract_worker *extract_workers;
+static size_t extract_worker_next;
+
+/* Header of a file passed to an extraction worker, along with its
+   descriptor.  It is followed by the file name and by the file data,
+   each chunk of which is preceded by its size.  A chunk of size 0
+   ends the file.  Each of these items is wholly within a batch.  */
+struct extract_job
+{
+  size_t file_name_len;
+  off_t size;
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  struct timespec atime;
+  struct timespec mtime;
+  mode_t current_mode;
+  mode_t current_mode_mask;
+  int atflag;
+  char typeflag;
+};
+
+/* The batch being processed by an extraction worker.  */
+static char *worker_batch;
+static size_t worker_batch_size;
+static size_t worker_batch_used;
+static size_t worker_batch_pos;
+static int worker_fds[EXTRACT_BATCH_FILES];
+static size_t worker_files;
+static size_t worker_file_pos;
+
+/* Receive the next batch from SOCK.  Return false at its end.  */
+static bool
+extract_worker_recv_batch (int sock)
+{
+  struct extract_batch batch;
+  size_t files = EXTRACT_BATCH_FILES;
+
+  if (! sys_recv_full (sock, worker_fds, &files, &batch, sizeof batch))
+    return false;
+  if (files != batch.files)
+    FATAL_ERROR ((0, 0, _("No file descriptor received from tar")));
+  if (worker_batch_size < batch.size)
+    {
+      worker_batch_size = batch.size;
+      worker_batch = xrealloc (worker_batch, worker_batch_size);
+    }
+  if (! sys_recv_full (sock, NULL, NULL, worker_batch, batch.size))
+    FATAL_ERROR ((0, errno, _("Cannot receive data from tar")));
+  worker_batch_used = batch.size;
+  worker_batch_pos = 0;
+  worker_files = files;
+  worker_file_pos = 0;
+  return true;
+}
+
+/* Return the next item of SIZE bytes received from SOCK.  */
+static void *
+extract_worker_recv (int sock, size_t size)
+{
+  char *item;
+
+  if (worker_batch_pos == worker_batch_used
+      && ! extract_worker_recv_batch (sock))
+    FATAL_ERROR ((0, errno, _("Cannot receive data from tar")));
+  if (worker_batch_used - worker_batch_pos < size)
+    FATAL_ERROR ((0, 0, _("Invalid data received from tar")));
+  item = worker_batch + worker_batch_pos;
+  worker_batch_pos += size;
+  return item;
+}
+
+/* Write the files passed over SOCK until it is closed.  */
+static _Noreturn void
+extract_worker_main (int sock)
+{
+  struct extract_job job;
+  char *file_name = NULL;
+  size_t file_name_size = 0;
+
+  while (worker_batch_pos < worker_batch_used
+	 || extract_worker_recv_batch (sock))
+    {
+      struct tar_stat_info st;
+      struct cache_control cache;
+      bool ok = true;
+      int fd;
+
+      memcpy (&job, extract_worker_recv (sock, sizeof job), sizeof job);
+      if (worker_file_pos == worker_files)
+	FATAL_ERROR ((0, 0, _("No file descriptor received from tar")));
+      fd = worker_fds[worker_file_pos++];
+
+      if (file_name_size <= job.file_name_len)
+	{
+	  file_name_size = job.file_name_len + 1;
+	  file_name = xrealloc (file_name, file_name_size);
+	}
+      memcpy (file_name, extract_worker_recv (sock, job.file_name_len),
+	      job.file_name_len);
+      file_name[job.file_name_len] = 0;
+
+      cache_begin (&cache, fd, job.size, true, cache_policy_option);
+      for (;;)
+	{
+	  size_t size;
+	  size_t count;
+	  char const *buf;
+
+	  memcpy (&size, extract_worker_recv (sock, sizeof size), sizeof size);
+	  if (size == 0)
+	    break;
+	  if (size > record_size)
+	    FATAL_ERROR ((0, 0, _("Invalid data received from tar")));
+	  buf = extract_worker_recv (sock, size);
+	  if (ok)
+	    {
+	      count = cache_write (&cache, buf, size);
+	      if (count != size)
+		{
+		  write_error_details (file_name, count, size);
+		  ok = false;
+		}
+	    }
+	}
+      if (! cache_end (&cache) && ok)
+	write_error (file_name);
+
+      memset (&st, 0, sizeof st);
+      st.stat.st_mode = job.mode;
+      st.stat.st_uid = job.uid;
+      st.stat.st_gid = job.gid;
+      st.atime = job.atime;
+      st.mtime = job.mtime;
+      set_stat (file_name, &st, fd, job.current_mode, job.current_mode_mask,
+		job.typeflag, false, job.atflag);
+
+      if (close (fd) != 0)
+	close_error (file_name);
+    }
+
+  exit (exit_status);
+}
+
+static void
+start_extract_workers (void)
+{
+  size_t i;
+  size_t files = sys_open_files_max () / 2 / extract_workers_option;
+
+  extract_batch_files = max (1, min (files, EXTRACT_BATCH_FILES));
+  extract_workers = xcalloc (extract_workers_option, sizeof *extract_workers);
+
+  /* Don't let the workers inherit buffered output.  */
+  fflush (NULL);
+
+  for (i = 0; i < extract_workers_option; i++)
+    {
+      int sv[2];
+      pid_t pid;
+
+      sys_socketpair (sv, false);
+      pid = xfork ();
+      if (pid == 0)
+	{
+	  size_t j;
+
+	  set_program_name (_("tar (child)"));
+	  fatal_exit_hook = NULL;
+	  exit_status = TAREXIT_SUCCESS;
+	  for (j = 0; j < i; j++)
+	    close (extract_workers[j].sock);
+	  close (sv[0]);
+	  extract_worker_main (sv[1]);
+	}
+
+      close (sv[1]);
+      extract_workers[i].pid = pid;
+      extract_workers[i].sock = sv[0];
+      extract_workers[i].batch_size = EXTRACT_BATCH_SIZE;
+      extract_workers[i].batch = xmalloc (EXTRACT_BATCH_SIZE);
+      extract_workers[i].batch_used = sizeof (struct extract_batch);
+    }
+}
+
+/* Return true if regular files may be written by extraction workers,
+   i.e. if nothing done after writing a file depends on its data
+   having been written.  */
+static bool
+extract_workers_usable (void)
+{
+  return (extract_workers_option
+	  && ! to_stdout_option && ! to_command_option
+	  && ! backup_option
+	  && old_files_option != OVERWRITE_OLD_FILES
+	  && old_files_option != KEEP_NEWER_FILES
+	  && xattrs_option <= 0 && acls_option <= 0
+	  && selinux_context_option <= 0);
+}
+
+/* Send the batch collected for the worker W, and close the
+   descriptors passed with it.  */
+static void
+extract_worker_flush (struct extract_worker *w)
+{
+  struct extract_batch batch;
+  size_t i;
+
+  if (w->batch_used <= sizeof batch)
+    return;
+
+  batch.size = w->batch_used - sizeof batch;
+  batch.files = w->files;
+  memcpy (w->batch, &batch, sizeof batch);
+  if (! sys_send_full (w->sock, w->fds, w->files, w->batch, w->batch_used))
+    FATAL_ERROR ((0, errno, _("Cannot pass data to extraction worker")));
+
+  for (i = 0; i < w->files; i++)
+    {
+      if (close (w->fds[i]) != 0)
+	close_error (w->names[i]);
+      free (w->names[i]);
+    }
+  w->files = 0;
+  w->batch_used = sizeof batch;
+}
+
+/* Send the batches of all extraction workers that hold descriptors,
+   so as to close these descriptors.  Return true if any was closed.  */
+static bool
+extract_workers_release_fds (void)
+{
+  bool released = false;
+  size_t i;
+
+  if (extract_workers)
+    for (i = 0; i < extract_workers_option; i++)
+      if (extract_workers[i].files)
+	{
+	  extract_worker_flush (&extract_workers[i]);
+	  released = true;
+	}
+  return released;
+}
+
+/* Add to the batch of the worker W the SIZE1 bytes at BUF1 followed
+   by the SIZE2 bytes at BUF2, sending the batch first if they do not
+   fit.  */
+static void
+extract_worker_add (struct extract_worker *w,
+		    void const *buf1, size_t size1,
+		    void const *buf2, size_t size2)
+{
+  size_t size = size1 + size2;
+
+  if (w->batch_size - w->batch_used < size)
+    {
+      extract_worker_flush (w);
+      if (w->batch_size - w->batch_used < size)
+	{
+	  w->batch_size = w->batch_used + size;
+	  w->batch = xrealloc (w->batch, w->batch_size);
+	}
+    }
+  memcpy (w->batch + w->batch_used, buf1, size1);
+  memcpy (w->batch + w->batch_used + size1, buf2, size2);
+  w->batch_used += size;
+}
+
+/* Pass the SIZE bytes of file data at BUF to the worker W.  A SIZE
+   of 0 ends the file.  */
+static void
+extract_worker_write (struct extract_worker *w, void const *buf, size_t size)
+{
+  extract_worker_add (w, &size, sizeof size, buf, size);
+}
+
+/* Pass FILE_NAME, open on FD, to the next extraction worker, which
+   takes over FD.  CURRENT_MODE, CURRENT_MODE_MASK, TYPEFLAG and ATFLAG
+   are as for set_stat.  Return the worker the file data is to be
+   written to.  */
+static struct extract_worker *
+extract_worker_begin (char const *file_name, int fd,
+		      mode_t current_mode, mode_t current_mode_mask,
+		      char typeflag, int atflag)
+{
+  struct extract_worker *w;
+  struct extract_job job;
+
+  if (! extract_workers)
+    start_extract_workers ();
+  w = &extract_workers[extract_worker_next];
+  extract_worker_next = (extract_worker_next + 1) % extract_workers_option;
+
+  memset (&job, 0, sizeof job);
+  job.file_name_len = strlen (file_name);
+  job.size = current_stat_info.stat.st_size;
+  job.mode = current_stat_info.stat.st_mode;
+  job.uid = current_stat_info.stat.st_uid;
+  job.gid = current_stat_info.stat.st_gid;
+  job.atime = current_stat_info.atime;
+  job.mtime = current_stat_info.mtime;
+  job.current_mode = current_mode;
+  job.current_mode_mask = current_mode_mask;
+  job.atflag = atflag;
+  job.typeflag = typeflag;
+
+  if (w->files == extract_batch_files)
+    extract_worker_flush (w);
+  extract_worker_add (w, &job, sizeof job, file_name, job.file_name_len);
+  w->fds[w->files] = fd;
+  w->names[w->files] = xstrdup (file_name);
+  w->files++;
+  return w;
+}
+
+/* Wait until the extraction workers have written all files passed
+   to them.  */
+static void
+finish_extract_workers (void)
+{
+  struct extract_worker *workers = extract_workers;
+  size_t i;
+
+  if (! workers)
+    return;
+  extract_workers = NULL;
+
+  for (i = 0; i < extract_workers_option; i++)
+    {
+      extract_worker_flush (&workers[i]);
+      free (workers[i].batch);
+      close (workers[i].sock);
+    }
+
+  for (i = 0; i < extract_workers_option; i++)
+    {
+      int wait_status;
+
+      while (waitpid (workers[i].pid, &wait_status, 0) == -1)
+	if (errno != EINTR)
+	  {
+	    waitpid_error (_("extraction worker"));
+	    break;
+	  }
+
+      if (WIFSIGNALED (wait_status))
+	ERROR ((0, 0, _("Extraction worker died with signal %d"),
+		WTERMSIG (wait_status)));
+      else if (WEXITSTATUS (wait_status) != 0)
+	set_exit_status (WEXITSTATUS (wait_status));
+    }
+
+  free (workers);
+  extract_worker_next = 0;
+}
+
 static int
 extract_file (char *file_name, int typeflag)
 {
@@ -1119,6 +1921,8 @@ extract_file (char *file_name, int typeflag)
                                                     : 0;
   mode_t current_mode = 0;
   mode_t current_mode_mask = 0;
+  struct extract_worker *worker = NULL;
+  struct cache_control cache;
 
   if (to_stdout_option)
     fd = STDOUT_FILENO;
@@ -1147,7 +1951,13 @@ extract_file (char *file_name, int typeflag)
                                      &current_mode_mask))
 	     < 0)
 	{
-	  int recover = maybe_recoverable (file_name, true, &interdir_made);
+	  int recover;
+
+	  /* Descriptors held for the extraction workers may have used
+	     up those tar may open.  */
+	  if (errno == EMFILE && extract_workers_release_fds ())
+	    continue;
+	  recover = maybe_recoverable (file_name, true, &interdir_made);
 	  if (recover != RECOVER_OK)
 	    {
 	      skip_member ();
@@ -1157,8 +1967,24 @@ extract_file (char *file_name, int typeflag)
 	      return 1;
 	    }
 	}
+      known_dir_add_parent (file_name);
+
+      /* Sparse files are allocated by sparse_extract_file, once their
+	 map is known.  */
+      if (preallocate_option && ! current_stat_info.is_sparse)
+	sys_allocate (fd, 0, current_stat_info.stat.st_size, true);
+
+      if (! current_stat_info.is_sparse && extract_workers_usable ())
+	worker = extract_worker_begin (file_name, fd,
+				       current_mode, current_mode_mask,
+				       typeflag, AT_SYMLINK_NOFOLLOW);
     }
 
+  cache_begin (&cache, fd, current_stat_info.stat.st_size, true,
+	       (to_stdout_option || to_command_option || worker
+		|| current_stat_info.is_sparse)
+	       ? CACHE_KEEP : cache_policy_option);
+
   mv_begin_read (&current_stat_info);
   if (current_stat_info.is_sparse)
     sparse_extract_file (fd, &current_stat_info, &size);
@@ -1167,6 +1993,26 @@ extract_file (char *file_name, int typeflag)
       {
 	mv_size_left (size);
 
+	/* Copy whole records of data straight into the file, if
+	   possible.  O_DIRECT writes, and data still in the cache
+	   buffer, must go through cache_write.  */
+	if (! to_stdout_option && ! to_command_option && ! worker
+	    && ! cache.direct && cache.buffer_used == 0)
+	  {
+	    int e;
+	    off_t copied = copy_archive_to_file (fd, size, &e);
+	    cache_advance (&cache, copied);
+	    size -= copied;
+	    if (e)
+	      {
+		errno = e;
+		write_error (file_name);
+		break;
+	      }
+	    if (size == 0)
+	      break;
+	  }
+
 	/* Locate data, determine max length writeable, write it,
 	   block that we have used the data, then check if the write
 	   worked.  */
@@ -1183,7 +2029,13 @@ extract_file (char *file_name, int typeflag)
 	if (written > size)
 	  written = size;
 	errno = 0;
-	count = blocking_write (fd, data_block->buffer, written);
+	if (worker)
+	  {
+	    extract_worker_write (worker, data_block->buffer, written);
+	    count = written;
+	  }
+	else
+	  count = cache_write (&cache, data_block->buffer, written);
 	size -= written;
 
 	set_next_block_after ((union block *)
@@ -1201,12 +2053,22 @@ extract_file (char *file_name, int typeflag)
 
   mv_end ();
 
+  /* The worker sets the attributes and closes the file.  */
+  if (worker)
+    {
+      extract_worker_write (worker, NULL, 0);
+      return 0;
+    }
+
   /* If writing to stdout, don't try to do anything to the filename;
      it doesn't exist, or we don't want to touch it anyway.  */
 
   if (to_stdout_option)
     return 0;
 
+  if (! cache_end (&cache))
+    write_error (file_name);
+
   if (! to_command_option)
     set_stat (file_name, &current_stat_info, fd,
 	      current_mode, current_mode_mask, typeflag, false,
@@ -1223,6 +2085,51 @@ extract_file (char *file_name, int typeflag)
   return status;
 }
 
+static size_t
+delayed_link_hash (void const *entry, size_t n_buckets)
+{
+  struct delayed_link const *ds = entry;
+  uintmax_t num = ds->dev ^ ds->ino;
+  return num % n_buckets;
+}
+
+static bool
+delayed_link_compare (void const *entry1, void const *entry2)
+{
+  struct delayed_link const *ds1 = entry1;
+  struct delayed_link const *ds2 = entry2;
+  return (ds1->dev == ds2->dev
+	  && ds1->ino == ds2->ino
+	  && ds1->change_dir == ds2->change_dir
+	  && timespec_cmp (ds1->birthtime, ds2->birthtime) == 0);
+}
+
+/* Enter DS into delayed_link_table, replacing any older link with the
+   same placeholder.  */
+static void
+hash_delayed_link (struct delayed_link *ds)
+{
+  void const *older;
+  int r;
+
+  if (! delayed_link_table)
+    {
+      delayed_link_table = hash_initialize (0, 0, delayed_link_hash,
+					    delayed_link_compare, NULL);
+      if (! delayed_link_table)
+	xalloc_die ();
+    }
+
+  r = hash_insert_if_absent (delayed_link_table, ds, &older);
+  if (r == 0)
+    {
+      hash_delete (delayed_link_table, older);
+      r = hash_insert_if_absent (delayed_link_table, ds, NULL);
+    }
+  if (r < 0)
+    xalloc_die ();
+}
+
 /* Create a placeholder file with name FILE_NAME, which will be
    replaced after other extraction is done by a symbolic link if
    IS_SYMLINK is true, and by a hard link otherwise.  Set
@@ -1292,6 +2199,7 @@ create_placeholder_file (char *file_name, bool is_symlink, bool *interdir_made)
       p->acls_d_len = 0;
       xheader_xattr_copy (&current_stat_info, &p->xattr_map, &p->xattr_map_size);
       strcpy (p->target, current_stat_info.link_name);
+      hash_delayed_link (p);
 
       h = delayed_set_stat_head;
       if (h && ! h->after_links
@@ -1327,23 +2235,24 @@ extract_link (char *file_name, int typeflag)
 
       if (status == 0)
 	{
-	  struct delayed_link *ds = delayed_link_head;
-	  if (ds
+	  if (delayed_link_table
 	      && fstatat (chdir_fd, link_name, &st1, AT_SYMLINK_NOFOLLOW) == 0)
-	    for (; ds; ds = ds->next)
-	      if (ds->change_dir == chdir_current
-		  && ds->dev == st1.st_dev
-		  && ds->ino == st1.st_ino
-		  && (timespec_cmp (ds->birthtime, get_stat_birthtime (&st1))
-		      == 0))
+	    {
+	      struct delayed_link key, *ds;
+	      key.dev = st1.st_dev;
+	      key.ino = st1.st_ino;
+	      key.birthtime = get_stat_birthtime (&st1);
+	      key.change_dir = chdir_current;
+	      ds = hash_lookup (delayed_link_table, &key);
+	      if (ds)
 		{
 		  struct string_list *p =  xmalloc (offsetof (struct string_list, string)
 						    + strlen (file_name) + 1);
 		  strcpy (p->string, file_name);
 		  p->next = ds->sources;
 		  ds->sources = p;
-		  break;
 		}
+	    }
 	  return 0;
 	}
       else if ((e == EEXIST && strcmp (link_name, file_name) == 0)
@@ -1381,19 +2290,27 @@ extract_symlink (char *file_name, int typeflag)
 	  || contains_dot_dot (current_stat_info.link_name)))
     return create_placeholder_file (file_name, true, &interdir_made);
 
-  while (symlinkat (current_stat_info.link_name, chdir_fd, file_name) != 0)
-    switch (maybe_recoverable (file_name, false, &interdir_made))
-      {
-      case RECOVER_OK:
-	continue;
+  for (;;)
+    {
+      char const *base;
+      int dirfd = parent_dir_fd (file_name, &base);
 
-      case RECOVER_SKIP:
-	return 0;
+      if (symlinkat (current_stat_info.link_name, dirfd, base) == 0)
+	break;
 
-      case RECOVER_NO:
-	symlink_error (current_stat_info.link_name, file_name);
-	return -1;
-      }
+      switch (maybe_recoverable (file_name, false, &interdir_made))
+	{
+	case RECOVER_OK:
+	  continue;
+
+	case RECOVER_SKIP:
+	  return 0;
+
+	case RECOVER_NO:
+	  symlink_error (current_stat_info.link_name, file_name);
+	  return -1;
+	}
+    }
 
   set_stat (file_name, &current_stat_info, -1, 0, 0,
 	    SYMTYPE, false, AT_SYMLINK_NOFOLLOW);
@@ -1773,12 +2690,20 @@ apply_delayed_links (void)
     }
 
   delayed_link_head = 0;
+  if (delayed_link_table)
+    {
+      hash_free (delayed_link_table);
+      delayed_link_table = NULL;
+    }
 }
 
 /* Finish the extraction of an archive.  */
 void
 extract_finish (void)
 {
+  /* Wait for the files being written by extraction workers.  */
+  finish_extract_workers ();
+
   /* First, fix the status of ordinary directories that need fixing.  */
   apply_nonancestor_delayed_set_stat ("", 0);
 
@@ -1789,11 +2714,14 @@ extract_finish (void)
   /* Finally, fix the status of directories that are ancestors
      of delayed links.  */
   apply_nonancestor_delayed_set_stat ("", 1);
+
+  forget_all_dir_fds ();
 }
 
 bool
 rename_directory (char *src, char *dst)
 {
+  forget_known_directories ();
   if (renameat (chdir_fd, src, chdir_fd, dst) == 0)
     fixup_delayed_set_stat (src, dst);
   else
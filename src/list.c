@@ -175,13 +175,25 @@ read_and (void (*do_something) (void))
   name_gather ();
 
   open_archive (ACCESS_READ);
+  if (use_index_option || fast_list_option)
+    {
+      index_load ();
+      if (fast_list_option)
+	index_list_members ();
+    }
   do
     {
       prev_status = status;
       tar_stat_destroy (&current_stat_info);
 
+      /* Skip straight to the next member that may be wanted.  */
+      if ((use_index_option || fast_list_option) && ! index_seek_member ())
+	break;
+
       status = read_header (&current_header, &current_stat_info,
                             read_header_auto);
+      if ((use_index_option || fast_list_option) && status != HEADER_SUCCESS)
+	index_check_member (status, &current_stat_info);
       switch (status)
 	{
 	case HEADER_STILL_UNREAD:
@@ -194,6 +206,8 @@ read_and (void (*do_something) (void))
 	     Ensure incoming names are null terminated.  */
 	  decode_header (current_header, &current_stat_info,
 			 &current_format, 1);
+	  if (use_index_option || fast_list_option)
+	    index_check_member (status, &current_stat_info);
 	  if (! name_match (current_stat_info.file_name)
 	      || (TIME_OPTION_INITIALIZED (newer_mtime_option)
 		  /* FIXME: We get mtime now, and again later; this causes
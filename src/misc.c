@@ -591,6 +591,7 @@ safer_rmdir (const char *file_name)
   if (unlinkat (chdir_fd, file_name, AT_REMOVEDIR) == 0)
     {
       remove_delayed_set_stat (file_name);
+      forget_known_directory (file_name);
       return 0;
     }
   return -1;
@@ -1158,6 +1159,250 @@ page_aligned_alloc (void **ptr, size_t size)
   return ptr_align (*ptr, alignment);
 }
 
+
+/* Page cache control for the data of archived and extracted files.  */
+
+/* Number of bytes read or written between two calls that drop pages
+   from the page cache, or ask for pages to be read ahead.  */
+enum { CACHE_WINDOW = 8 * 1024 * 1024 };
+
+/* Files smaller than this are not read or written with O_DIRECT.  */
+enum { CACHE_DIRECT_MIN = 1024 * 1024 };
+
+/* Size of the buffer through which O_DIRECT data pass.  It is a
+   multiple of any block size O_DIRECT may require.  */
+enum { CACHE_DIRECT_BUFSIZE = 1024 * 1024 };
+
+/* Turn O_DIRECT on or off for the file of C.  Return true if it is
+   in the requested state.  */
+static bool
+cache_set_direct (struct cache_control *c, bool direct)
+{
+#ifdef O_DIRECT
+  int flags = fcntl (c->fd, F_GETFL);
+  if (flags < 0
+      || fcntl (c->fd, F_SETFL,
+		direct ? flags | O_DIRECT : flags & ~O_DIRECT) != 0)
+    return false;
+  c->direct = direct;
+  return true;
+#else
+  return ! direct;
+#endif
+}
+
+/* Start reading (if ! WRITING) or writing the SIZE bytes of data of
+   the file open on FD, and record in C how its pages are to be cached
+   according to POLICY.  */
+void
+cache_begin (struct cache_control *c, int fd, off_t size, bool writing,
+	     enum cache_policy policy)
+{
+  memset (c, 0, sizeof *c);
+  c->fd = fd;
+  c->writing = writing;
+  c->policy = policy;
+
+  if (policy == CACHE_DIRECT)
+    {
+      if (CACHE_DIRECT_MIN <= size && cache_set_direct (c, true))
+	{
+	  static void *direct_buffer_ptr;
+	  static char *direct_buffer;
+	  if (! direct_buffer)
+	    direct_buffer = page_aligned_alloc (&direct_buffer_ptr,
+						CACHE_DIRECT_BUFSIZE);
+	  c->buffer = direct_buffer;
+	}
+      else
+	c->policy = CACHE_DROP;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  if (c->policy == CACHE_DROP && ! writing)
+    {
+      posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+      posix_fadvise (fd, 0, CACHE_WINDOW, POSIX_FADV_WILLNEED);
+    }
+#endif
+}
+
+/* Drop the pages of the file of C that lie before its current offset
+   from the page cache, and ask for the following ones to be read
+   ahead.  When writing, dirty pages cannot be dropped: unless WAIT,
+   only drop those whose writeback the previous call started, and
+   start writing back the others.  */
+static void
+cache_drop (struct cache_control *c, bool wait)
+{
+#ifdef POSIX_FADV_DONTNEED
+  if (c->writing)
+    {
+      off_t end = wait ? c->offset : c->mark;
+# ifdef SYNC_FILE_RANGE_WRITE
+      if (c->dropped < end)
+	sync_file_range (c->fd, c->dropped, end - c->dropped,
+			 (SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE
+			  | SYNC_FILE_RANGE_WAIT_AFTER));
+      if (end < c->offset)
+	sync_file_range (c->fd, end, c->offset - end, SYNC_FILE_RANGE_WRITE);
+# else
+      if (wait)
+	fdatasync (c->fd);
+# endif
+      if (c->dropped < end)
+	posix_fadvise (c->fd, c->dropped, end - c->dropped,
+		       POSIX_FADV_DONTNEED);
+      c->dropped = end;
+    }
+  else
+    {
+      posix_fadvise (c->fd, c->dropped, c->offset - c->dropped,
+		     POSIX_FADV_DONTNEED);
+      c->dropped = c->offset;
+      posix_fadvise (c->fd, c->offset, CACHE_WINDOW, POSIX_FADV_WILLNEED);
+    }
+#endif
+  c->mark = c->offset;
+}
+
+/* Record that SIZE more bytes of the file of C have been read or
+   written.  */
+void
+cache_advance (struct cache_control *c, off_t size)
+{
+  c->offset += size;
+  if (c->policy != CACHE_KEEP && CACHE_WINDOW <= c->offset - c->mark)
+    cache_drop (c, false);
+}
+
+/* Read up to SIZE bytes from the file of C into BUF, as blocking_read
+   does.  Data left in the O_DIRECT buffer are returned first, even if
+   O_DIRECT has been turned off since they were read.  */
+size_t
+cache_read (struct cache_control *c, void *buf, size_t size)
+{
+  char *p = buf;
+  size_t done = 0;
+
+  while (done < size)
+    {
+      size_t n;
+
+      if (c->buffer_pos == c->buffer_used)
+	{
+	  if (! c->direct)
+	    {
+	      /* Read the rest straight into BUF, as without O_DIRECT.  */
+	      n = blocking_read (c->fd, p + done, size - done);
+	      if (n == SAFE_READ_ERROR)
+		return n;
+	      done += n;
+	      break;
+	    }
+
+	  n = blocking_read (c->fd, c->buffer, CACHE_DIRECT_BUFSIZE);
+	  if (n == SAFE_READ_ERROR)
+	    {
+	      /* Some file systems accept O_DIRECT but not the reads.  */
+	      if (errno == EINVAL && cache_set_direct (c, false))
+		continue;
+	      return n;
+	    }
+	  if (n == 0)
+	    break;
+	  c->buffer_pos = 0;
+	  c->buffer_used = n;
+	}
+
+      n = c->buffer_used - c->buffer_pos;
+      if (size - done < n)
+	n = size - done;
+      memcpy (p + done, c->buffer + c->buffer_pos, n);
+      c->buffer_pos += n;
+      done += n;
+    }
+  cache_advance (c, done);
+  return done;
+}
+
+/* Write the data buffered for O_DIRECT in C.  The last, partial block
+   of a file is written without O_DIRECT, and so is everything if the
+   file system rejects O_DIRECT writes.  Return false on error, with
+   errno set.  */
+static bool
+cache_flush (struct cache_control *c)
+{
+  size_t size = c->buffer_used;
+  size_t count;
+
+  if (size == 0)
+    return true;
+  c->buffer_used = 0;
+  if (size < CACHE_DIRECT_BUFSIZE)
+    cache_set_direct (c, false);
+  count = blocking_write (c->fd, c->buffer, size);
+  if (count != size && errno == EINVAL && c->direct
+      && cache_set_direct (c, false))
+    count += blocking_write (c->fd, c->buffer + count, size - count);
+  cache_advance (c, count);
+  return count == size;
+}
+
+/* Write the SIZE bytes at BUF to the file of C, as blocking_write does.
+   With O_DIRECT, the data may be kept in a buffer until a later call.  */
+size_t
+cache_write (struct cache_control *c, void const *buf, size_t size)
+{
+  char const *p = buf;
+  size_t done = 0;
+
+  while (done < size)
+    {
+      size_t n;
+
+      if (! c->direct && c->buffer_used == 0)
+	{
+	  /* Write the rest straight from BUF, as without O_DIRECT.  */
+	  n = blocking_write (c->fd, p + done, size - done);
+	  cache_advance (c, n);
+	  return done + n;
+	}
+
+      n = CACHE_DIRECT_BUFSIZE - c->buffer_used;
+      if (size - done < n)
+	n = size - done;
+      memcpy (c->buffer + c->buffer_used, p + done, n);
+      c->buffer_used += n;
+      if (c->buffer_used == CACHE_DIRECT_BUFSIZE && ! cache_flush (c))
+	return done;
+      done += n;
+    }
+  return done;
+}
+
+/* Finish reading or writing the file of C.  Write out any buffered
+   data, and drop the file's pages from the page cache if asked to.
+   Return false on a write error, with errno set.  */
+bool
+cache_end (struct cache_control *c)
+{
+  bool ok = ! c->writing || cache_flush (c);
+
+  if (c->policy != CACHE_KEEP)
+    {
+      /* Wait only for large files to be written, so that extracting
+	 many small files does not wait for each of them in turn.  */
+      cache_drop (c, c->writing && CACHE_WINDOW <= c->offset);
+#ifdef POSIX_FADV_DONTNEED
+      posix_fadvise (c->fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    }
+  if (c->direct)
+    cache_set_direct (c, false);
+  return ok;
+}
+
 
 
 struct namebuf
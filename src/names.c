@@ -266,7 +266,7 @@ add_exclude_array (char const * const * fv, int opts)
   int i;
 
   for (i = 0; fv[i]; i++)
-    add_exclude (excluded, fv[i], opts);
+    add_exclude_indexed (excluded, fv[i], opts);
 }
 
 static void
@@ -279,7 +279,7 @@ handle_file_selection_option (int key, const char *arg)
       break;
 
     case EXCLUDE_OPTION:
-      add_exclude (excluded, arg, EXCLUDE_OPTIONS);
+      add_exclude_indexed (excluded, arg, EXCLUDE_OPTIONS);
       break;
 
     case EXCLUDE_CACHES_OPTION:
@@ -352,7 +352,7 @@ handle_file_selection_option (int key, const char *arg)
       break;
 
     case 'X':
-      if (add_exclude_file (add_exclude, excluded, arg, EXCLUDE_OPTIONS, '\n')
+      if (add_exclude_file (add_exclude_indexed, excluded, arg, EXCLUDE_OPTIONS, '\n')
 	  != 0)
 	{
 	  int e = errno;
@@ -592,6 +592,175 @@ free_name (struct name *p)
 static struct name *namelist;	/* first name in list, if any */
 static struct name *nametail;	/* end of name list */
 
+/* Index of the namelist, used to match file names from the archive
+   without comparing them with every name in the list.
+
+   Literal names, i.e. those that are not patterns and are matched
+   case-sensitively, are kept in NAME_INDEX, a hash table keyed by the
+   name.  A file name is looked up there together with its leading
+   directories (for names that match recursively) and, for names that
+   are not anchored, with its trailing parts.  Other names are kept in
+   NAME_PATTERNS, in namelist order, and are tried one by one.  The
+   ORDINAL member of the names keeps the namelist order, so that the
+   first matching name wins as it would in a linear search.  */
+
+static Hash_table *name_index;
+static struct name **name_patterns;
+static size_t name_pattern_count;
+static size_t name_pattern_allocated;
+
+/* True if NAME_INDEX is up to date with the namelist.  */
+static bool name_index_valid;
+
+/* True if some name in NAME_INDEX is not anchored.  */
+static bool name_index_unanchored;
+
+/* First name that may not have been found yet, for all_names_found,
+   if UNFOUND_CURSOR_SET.  */
+static struct name const *unfound_cursor;
+static bool unfound_cursor_set;
+
+static size_t
+name_key_hash (void const *entry, size_t n_buckets)
+{
+  struct name const *name = entry;
+  size_t value = 0;
+  size_t i;
+
+  for (i = 0; i < name->length; i++)
+    value = (value * 31 + (unsigned char) name->name[i]) % n_buckets;
+  return value;
+}
+
+static bool
+name_key_compare (void const *entry1, void const *entry2)
+{
+  struct name const *name1 = entry1;
+  struct name const *name2 = entry2;
+  return (name1->length == name2->length
+	  && memcmp (name1->name, name2->name, name1->length) == 0);
+}
+
+/* Return true if NAME can only match file names equal to it, or to
+   their leading or trailing parts.  */
+static bool
+name_is_literal (struct name const *name)
+{
+  int flags = name->matching_flags;
+
+  if (flags & FNM_CASEFOLD)
+    return false;
+  return (! (flags & EXCLUDE_WILDCARDS)
+	  || ! (fnmatch_pattern_has_wildcards (name->name, flags)
+		|| strchr (name->name, '\\')));
+}
+
+/* Add NAME, which follows all the names already indexed, to the
+   index.  */
+static void
+name_index_add (struct name *name)
+{
+  if (! name->name[0])
+    return;
+  if (name_is_literal (name))
+    {
+      struct name *p = hash_insert (name_index, name);
+      if (! p)
+	xalloc_die ();
+      if (p == name)
+	{
+	  if (! (name->matching_flags & EXCLUDE_ANCHORED))
+	    name_index_unanchored = true;
+	  return;
+	}
+      /* A duplicate, matched only if it differs in its flags.  */
+    }
+  if (name_pattern_count == name_pattern_allocated)
+    name_patterns = x2nrealloc (name_patterns, &name_pattern_allocated,
+				sizeof *name_patterns);
+  name_patterns[name_pattern_count++] = name;
+}
+
+/* Index the namelist, unless it is already indexed.  */
+static void
+name_index_build (void)
+{
+  struct name *p;
+  size_t ordinal = 0;
+
+  if (name_index_valid)
+    return;
+  if (! name_index)
+    name_index = hash_initialize (0, 0, name_key_hash, name_key_compare,
+				  NULL);
+  else
+    hash_clear (name_index);
+  if (! name_index)
+    xalloc_die ();
+  name_pattern_count = 0;
+  name_index_unanchored = false;
+  for (p = namelist; p; p = p->next)
+    {
+      p->ordinal = ordinal++;
+      name_index_add (p);
+    }
+  name_index_valid = true;
+}
+
+/* Forget the index after the namelist was reordered or discarded.  */
+static void
+name_index_invalidate (void)
+{
+  name_index_valid = false;
+  unfound_cursor_set = false;
+}
+
+/* Remove NAME from the index.  */
+static void
+name_index_remove (struct name const *name)
+{
+  size_t i;
+
+  if (unfound_cursor == name)
+    unfound_cursor = name->next;
+  if (! name_index_valid)
+    return;
+  if (hash_lookup (name_index, name) == name)
+    {
+      hash_delete (name_index, name);
+      return;
+    }
+  for (i = 0; i < name_pattern_count; i++)
+    if (name_patterns[i] == name)
+      {
+	memmove (name_patterns + i, name_patterns + i + 1,
+		 (name_pattern_count - i - 1) * sizeof *name_patterns);
+	name_pattern_count--;
+	return;
+      }
+}
+
+/* Return the indexed literal name that matches the part of FILE_NAME
+   from START to END, if any, provided that it precedes BEST in the
+   namelist.  Otherwise, return BEST.  */
+static struct name *
+name_index_lookup (char const *file_name, size_t start, size_t end,
+		   size_t length, struct name *best)
+{
+  struct name key;
+  struct name *p;
+
+  key.name = (char *) file_name + start;
+  key.length = end - start;
+  p = hash_lookup (name_index, &key);
+  if (! p
+      || (best && best->ordinal < p->ordinal)
+      || (end < length && ! (p->matching_flags & FNM_LEADING_DIR))
+      || (0 < start && (p->matching_flags & EXCLUDE_ANCHORED)))
+    return best;
+  return p;
+}
+
 /* File name arguments are processed in two stages: first a
    name element list (see below) is filled, then the names from it
    are moved into the namelist.
@@ -1061,6 +1230,7 @@ name_gather (void)
 	  buffer->cmdline = true;
 
 	  namelist = nametail = buffer;
+	  name_index_invalidate ();
 	}
       else if (change_dir)
 	addname (0, change_dir, false, NULL);
@@ -1108,6 +1278,11 @@ addname (char const *string, int change_dir, bool cmdline, struct name *parent)
   else
     namelist = name;
   nametail = name;
+  if (name_index_valid)
+    {
+      name->ordinal = name->prev ? name->prev->ordinal + 1 : 0;
+      name_index_add (name);
+    }
   return name;
 }
 
@@ -1116,16 +1291,37 @@ addname (char const *string, int change_dir, bool cmdline, struct name *parent)
 static struct name *
 namelist_match (char const *file_name, size_t length)
 {
-  struct name *p;
+  struct name *best = NULL;
+  size_t start;
+  size_t i;
 
-  for (p = namelist; p; p = p->next)
+  name_index_build ();
+
+  /* Look up the file name and its leading directories, starting after
+     each slash if some names are not anchored.  */
+  for (start = 0; start <= length; start++)
+    {
+      if (0 < start
+	  && ! (name_index_unanchored
+		&& ISSLASH (file_name[start - 1])
+		&& ! ISSLASH (file_name[start])))
+	continue;
+      for (i = start; i < length; i++)
+	if (ISSLASH (file_name[i]))
+	  best = name_index_lookup (file_name, start, i, length, best);
+      best = name_index_lookup (file_name, start, length, length, best);
+    }
+
+  for (i = 0; i < name_pattern_count; i++)
     {
-      if (p->name[0]
-	  && exclude_fnmatch (p->name, file_name, p->matching_flags))
+      struct name *p = name_patterns[i];
+      if (best && best->ordinal < p->ordinal)
+	break;
+      if (exclude_fnmatch (p->name, file_name, p->matching_flags))
 	return p;
     }
 
-  return NULL;
+  return best;
 }
 
 void
@@ -1133,6 +1329,7 @@ remname (struct name *name)
 {
   struct name *p;
 
+  name_index_remove (name);
   if ((p = name->prev) != NULL)
     p->next = name->next;
   else
@@ -1163,6 +1360,7 @@ name_match (const char *file_name)
 	  chdir_do (cursor->change_dir);
 	  namelist = NULL;
 	  nametail = NULL;
+	  name_index_invalidate ();
 	  return true;
 	}
 
@@ -1177,6 +1375,7 @@ name_match (const char *file_name)
 	      free (namelist);
 	      namelist = NULL;
 	      nametail = NULL;
+	      name_index_invalidate ();
 	    }
 	  chdir_do (cursor->change_dir);
 
@@ -1200,6 +1399,18 @@ name_match (const char *file_name)
     }
 }
 
+/* Return true if name_match may accept FILE_NAME (from an archive).
+   Unlike name_match, do not record the match.  */
+bool
+name_wanted_p (const char *file_name)
+{
+  struct name const *cursor = namelist;
+
+  if (!cursor || cursor->name[0] == 0)
+    return true;
+  return namelist_match (file_name, strlen (file_name)) != NULL;
+}
+
 /* Returns true if all names from the namelist were processed.
    P is the stat_info of the most recently processed entry.
    The decision is postponed until the next entry is read if:
@@ -1217,11 +1428,22 @@ all_names_found (struct tar_stat_info *p)
 
   if (!p->file_name || occurrence_option == 0 || p->had_trailing_slash)
     return false;
+
+  /* Names that were found stay found, so resume the search for one
+     that was not where the previous call stopped.  */
+  if (!unfound_cursor_set)
+    {
+      unfound_cursor = namelist;
+      unfound_cursor_set = true;
+    }
+  for (; unfound_cursor; unfound_cursor = unfound_cursor->next)
+    if (unfound_cursor->name[0] && !WASFOUND (unfound_cursor))
+      return false;
+
   len = strlen (p->file_name);
   for (cursor = namelist; cursor; cursor = cursor->next)
     {
-      if ((cursor->name[0] && !WASFOUND (cursor))
-	  || (len >= cursor->length && ISSLASH (p->file_name[cursor->length])))
+      if (len >= cursor->length && ISSLASH (p->file_name[cursor->length]))
 	return false;
     }
   return true;
@@ -1267,6 +1489,7 @@ names_notfound (void)
   /* Don't bother freeing the name list; we're about to exit.  */
   namelist = NULL;
   nametail = NULL;
+  name_index_invalidate ();
 
   if (same_order_option)
     {
@@ -1306,6 +1529,7 @@ label_notfound (void)
   /* Don't bother freeing the name list; we're about to exit.  */
   namelist = NULL;
   nametail = NULL;
+  name_index_invalidate ();
 
   if (same_order_option)
     {
@@ -1702,6 +1926,7 @@ collect_and_sort_names (void)
   hash_free (nametab);
 
   namelist = merge_sort (namelist, num_names, compare_names_found);
+  name_index_invalidate ();
 
   if (listed_incremental_option)
     {
@@ -1774,6 +1999,7 @@ blank_name_list (void)
   gnu_list_name = 0;
   for (name = namelist; name; name = name->next)
     name->found_count = 0;
+  name_index_invalidate ();
 }
 
 /* Yield a newly allocated file name consisting of DIR_NAME concatenated to
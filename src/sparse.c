@@ -56,8 +56,24 @@ struct tar_sparse_file
   struct tar_sparse_optab const *optab; /* Operation table */
   void *closure;                    /* Any additional data optab calls might
 				       require */
+  char *cache;                      /* Contents of the data regions, as
+				       read by sparse_scan_file_raw, or NULL
+				       if they must be read again */
+  size_t cache_size;                /* Number of bytes in cache */
+  size_t cache_alloc;               /* Allocated size of cache */
+  size_t cache_pos;                 /* Bytes of cache already dumped */
 };
 
+/* Size of the buffer in which sparse_scan_file_raw reads files.  */
+enum { SPARSE_SCAN_BUFSIZE = 1024 * BLOCKSIZE };
+
+/* Number of extents that sparse_scan_file_fiemap asks for at a time.  */
+enum { SPARSE_EXTENT_BATCH = 1024 };
+
+/* Maximum size of the data regions that sparse_scan_file_raw keeps
+   for dumping, so that they need not be read twice.  */
+enum { SPARSE_CACHE_MAX = 16 * 1024 * 1024 };
+
 /* Dump zeros to file->fd until offset is reached. It is used instead of
    lseek if the output file is not seekable */
 static bool
@@ -116,6 +132,8 @@ tar_sparse_init (struct tar_sparse_file *file)
 static bool
 tar_sparse_done (struct tar_sparse_file *file)
 {
+  free (file->cache);
+  file->cache = NULL;
   if (file->optab->done)
     return file->optab->done (file);
   return true;
@@ -186,14 +204,18 @@ lseek_or_error (struct tar_sparse_file *file, off_t offset)
 
 /* Takes a blockful of data and basically cruises through it to see if
    it's made *entirely* of zeros, returning a 0 the instant it finds
-   something that is a nonzero, i.e., useful data.  */
+   something that is a nonzero, i.e., useful data.  The comparison is
+   left to memcmp, which C libraries implement with the widest vector
+   instructions the processor supports.  */
 static bool
 zero_block_p (char const *buffer, size_t size)
 {
-  while (size--)
-    if (*buffer++)
+  static char const zero_buf[BLOCKSIZE];
+
+  for (; BLOCKSIZE < size; buffer += BLOCKSIZE, size -= BLOCKSIZE)
+    if (memcmp (buffer, zero_buf, BLOCKSIZE) != 0)
       return false;
-  return true;
+  return memcmp (buffer, zero_buf, size) == 0;
 }
 
 static void
@@ -208,47 +230,107 @@ sparse_add_map (struct tar_stat_info *st, struct sp_array const *sp)
   st->sparse_map_avail = avail + 1;
 }
 
-/* Scan the sparse file byte-by-byte and create its map. */
+/* Read up to SIZE bytes from FD into BUF, stopping short only at end
+   of file.  Return the number of bytes read, or SAFE_READ_ERROR.  */
+static size_t
+sparse_read (int fd, char *buf, size_t size)
+{
+  size_t total = 0;
+
+  while (total < size)
+    {
+      size_t count = blocking_read (fd, buf + total, size - total);
+      if (count == SAFE_READ_ERROR)
+	return count;
+      if (count == 0)
+	break;
+      total += count;
+    }
+  return total;
+}
+
+/* Append the SIZE bytes at DATA to the data regions kept for dumping
+   FILE.  Return false, and forget those kept so far, if they would
+   grow too large.  */
+static bool
+sparse_cache_add (struct tar_sparse_file *file, char const *data, size_t size)
+{
+  if (SPARSE_CACHE_MAX - file->cache_size < size)
+    {
+      free (file->cache);
+      file->cache = NULL;
+      file->cache_size = file->cache_alloc = 0;
+      return false;
+    }
+  while (file->cache_alloc - file->cache_size < size)
+    file->cache = x2realloc (file->cache, &file->cache_alloc);
+  memcpy (file->cache + file->cache_size, data, size);
+  file->cache_size += size;
+  return true;
+}
+
+/* Scan the sparse file block by block and create its map.  Keep the
+   data read, unless there is too much of it, so that sparse_dump_region
+   does not read it again.  */
 static bool
 sparse_scan_file_raw (struct tar_sparse_file *file)
 {
   struct tar_stat_info *st = file->stat_info;
   int fd = file->fd;
-  char buffer[BLOCKSIZE];
+  static char *buffer;
   size_t count = 0;
   off_t offset = 0;
   struct sp_array sp = {0, 0};
+  bool caching = true;
 
   st->archive_file_size = 0;
 
   if (!tar_sparse_scan (file, scan_begin, NULL))
     return false;
 
-  while ((count = blocking_read (fd, buffer, sizeof buffer)) != 0
-         && count != SAFE_READ_ERROR)
+  if (!buffer)
+    buffer = xmalloc (SPARSE_SCAN_BUFSIZE);
+
+  while ((count = sparse_read (fd, buffer, SPARSE_SCAN_BUFSIZE)) != 0)
     {
-      /* Analyze the block.  */
-      if (zero_block_p (buffer, count))
-        {
-          if (sp.numbytes)
-            {
-              sparse_add_map (st, &sp);
-              sp.numbytes = 0;
-              if (!tar_sparse_scan (file, scan_block, NULL))
-                return false;
-            }
-        }
-      else
-        {
-          if (sp.numbytes == 0)
-            sp.offset = offset;
-          sp.numbytes += count;
-          st->archive_file_size += count;
-          if (!tar_sparse_scan (file, scan_block, buffer))
-            return false;
-        }
+      size_t i;
+
+      if (count == SAFE_READ_ERROR)
+	{
+	  read_diag_details (st->orig_file_name, offset, SPARSE_SCAN_BUFSIZE);
+	  return false;
+	}
+
+      for (i = 0; i < count; i += BLOCKSIZE)
+	{
+	  char *block = buffer + i;
+	  size_t size = count - i < BLOCKSIZE ? count - i : BLOCKSIZE;
+
+	  /* Analyze the block.  */
+	  if (zero_block_p (block, size))
+	    {
+	      if (sp.numbytes)
+		{
+		  sparse_add_map (st, &sp);
+		  sp.numbytes = 0;
+		  if (!tar_sparse_scan (file, scan_block, NULL))
+		    return false;
+		}
+	    }
+	  else
+	    {
+	      if (sp.numbytes == 0)
+		sp.offset = offset;
+	      sp.numbytes += size;
+	      st->archive_file_size += size;
+	      if (caching)
+		caching = sparse_cache_add (file, block, size);
+	      if (!tar_sparse_scan (file, scan_block, block))
+		return false;
+	    }
 
-      offset += count;
+	  offset += size;
+	}
     }
 
   /* save one more sparse segment of length 0 to indicate that
@@ -257,7 +339,6 @@ sparse_scan_file_raw (struct tar_sparse_file *file)
     sp.offset = offset;
 
   sparse_add_map (st, &sp);
-  st->archive_file_size += count;
   return tar_sparse_scan (file, scan_end, NULL);
 }
 
@@ -340,6 +421,74 @@ sparse_scan_file_seek (struct tar_sparse_file *file)
 }
 #endif
 
+/* Get the map of the file from the extents of data the file system
+   reports for it.  Extents that are allocated but unwritten are holes.  */
+static bool
+sparse_scan_file_fiemap (struct tar_sparse_file *file)
+{
+  struct tar_stat_info *st = file->stat_info;
+  off_t size = st->stat.st_size;
+  off_t offset = 0;
+  struct sp_array sp = {0, 0};
+  static struct sp_array *extents;
+  bool last = false;
+
+  if (!extents)
+    extents = xnmalloc (SPARSE_EXTENT_BATCH, sizeof *extents);
+
+  st->archive_file_size = 0;
+
+  while (!last && offset < size)
+    {
+      ssize_t i;
+      ssize_t n = sys_file_data_extents (file->fd, &offset, extents,
+					 SPARSE_EXTENT_BATCH, &last);
+      if (n < 0)
+	{
+	  st->sparse_map_avail = 0;
+	  return false;
+	}
+
+      for (i = 0; i < n; i++)
+	{
+	  off_t beg = extents[i].offset;
+	  off_t end = beg + extents[i].numbytes;
+
+	  if (size < end)
+	    end = size;
+	  if (end <= beg)
+	    continue;
+
+	  /* Merge extents that are adjacent in the file.  */
+	  if (sp.numbytes && sp.offset + sp.numbytes == beg)
+	    sp.numbytes += end - beg;
+	  else
+	    {
+	      if (sp.numbytes)
+		{
+		  sparse_add_map (st, &sp);
+		  st->archive_file_size += sp.numbytes;
+		}
+	      sp.offset = beg;
+	      sp.numbytes = end - beg;
+	    }
+	}
+    }
+
+  if (sp.numbytes)
+    {
+      sparse_add_map (st, &sp);
+      st->archive_file_size += sp.numbytes;
+    }
+
+  /* End the map with an empty chunk of data, as sparse_scan_file_seek
+     does.  */
+  sp.offset = size;
+  sp.numbytes = 0;
+  sparse_add_map (st, &sp);
+  return true;
+}
+
 static bool
 sparse_scan_file (struct tar_sparse_file *file)
 {
@@ -350,6 +499,10 @@ sparse_scan_file (struct tar_sparse_file *file)
   switch (hole_detection)
     {
     case HOLE_DETECTION_DEFAULT:
+    case HOLE_DETECTION_FIEMAP:
+      if (sparse_scan_file_fiemap (file))
+	return true;
+      /* FALL THROUGH */
     case HOLE_DETECTION_SEEK:
 #ifdef SEEK_HOLE
       if (sparse_scan_file_seek (file))
@@ -407,7 +560,8 @@ sparse_dump_region (struct tar_sparse_file *file, size_t i)
   union block *blk;
   off_t bytes_left = file->stat_info->sparse_map[i].numbytes;
 
-  if (!lseek_or_error (file, file->stat_info->sparse_map[i].offset))
+  if (!file->cache
+      && !lseek_or_error (file, file->stat_info->sparse_map[i].offset))
     return false;
 
   while (bytes_left > 0)
@@ -416,7 +570,15 @@ sparse_dump_region (struct tar_sparse_file *file, size_t i)
       size_t bytes_read;
 
       blk = find_next_block ();
-      bytes_read = safe_read (file->fd, blk->buffer, bufsize);
+      if (file->cache)
+	{
+	  /* The data were kept when the file was scanned.  */
+	  memcpy (blk->buffer, file->cache + file->cache_pos, bufsize);
+	  file->cache_pos += bufsize;
+	  bytes_read = bufsize;
+	}
+      else
+	bytes_read = safe_read (file->fd, blk->buffer, bufsize);
       if (bytes_read == SAFE_READ_ERROR)
 	{
           read_diag_details (file->stat_info->orig_file_name,
@@ -561,6 +723,40 @@ sparse_fixup_header (struct tar_stat_info *st)
   return tar_sparse_fixup_header (&file);
 }
 
+/* Allocate disk space for the sparse file FILE, which is about to be
+   extracted, as --preallocate requests.  Failures are not errors: the
+   file is then written without it.  */
+static void
+sparse_preallocate (struct tar_sparse_file *file)
+{
+  struct tar_stat_info *st = file->stat_info;
+  struct sp_array const *map = st->sparse_map;
+  size_t avail = st->sparse_map_avail;
+  off_t hole = 0;
+  size_t i;
+
+  if (preallocate_option == PREALLOCATE_DATA)
+    {
+      for (i = 0; i < avail; i++)
+	if (!sys_allocate (file->fd, map[i].offset, map[i].numbytes, true))
+	  break;
+    }
+  else if (avail
+	   && sys_allocate (file->fd, 0,
+			    map[avail - 1].offset + map[avail - 1].numbytes,
+			    false))
+    {
+      /* The whole file is allocated, so that its data lie together.
+	 Give back the space of its holes.  */
+      for (i = 0; i < avail; i++)
+	{
+	  if (!sys_punch_hole (file->fd, hole, map[i].offset - hole))
+	    break;
+	  hole = map[i].offset + map[i].numbytes;
+	}
+    }
+}
+
 enum dump_status
 sparse_extract_file (int fd, struct tar_stat_info *st, off_t *size)
 {
@@ -577,6 +773,8 @@ sparse_extract_file (int fd, struct tar_stat_info *st, off_t *size)
   file.offset = 0;
 
   rc = tar_sparse_decode_header (&file);
+  if (rc && preallocate_option && file.seekable && !EXTRACT_OVER_PIPE)
+    sparse_preallocate (&file);
   for (i = 0; rc && i < file.stat_info->sparse_map_avail; i++)
     rc = tar_sparse_extract_region (&file, i);
   *size = file.stat_info->archive_file_size - file.dumped_size;
@@ -20,6 +20,7 @@
 
 #include "common.h"
 #include <priv-set.h>
+#include <quotearg.h>
 #include <rmt.h>
 #include <signal.h>
 #include <wordsplit.h>
@@ -71,6 +72,11 @@ sys_wait_for_child (pid_t child_pid, bool eof)
 {
 }
 
+void
+sys_kill_child (pid_t child_pid)
+{
+}
+
 void
 sys_spawn_shell (void)
 {
@@ -111,6 +117,26 @@ sys_write_archive_buffer (void)
   return full_write (archive, record_start->buffer, record_size);
 }
 
+bool
+sys_archive_is_regular (void)
+{
+  return false;
+}
+
+ssize_t
+sys_copy_to_archive (int fd, size_t size)
+{
+  errno = ENOSYS;
+  return -1;
+}
+
+ssize_t
+sys_copy_from_archive (int fd, size_t size)
+{
+  errno = ENOSYS;
+  return -1;
+}
+
 /* Set ARCHIVE for writing, then compressing an archive.  */
 void
 sys_child_open_for_compress (void)
@@ -120,13 +146,119 @@ sys_child_open_for_compress (void)
 
 /* Set ARCHIVE for uncompressing, then reading an archive.  */
 void
-sys_child_open_for_uncompress (void)
+sys_child_open_for_uncompress (off_t offset)
 {
   FATAL_ERROR ((0, 0, _("Cannot use compressed or remote archives")));
 }
 
+bool
+sys_archive_file_is_regular (void)
+{
+  return false;
+}
+
+/* Set ARCHIVE for writing through a queue of records.  Queuing is not
+   supported here: just write the archive directly.  */
+pid_t
+sys_child_open_for_write (void)
+{
+  return 0;
+}
+
+/* Set ARCHIVE for reading through a queue of records.  Likewise.  */
+pid_t
+sys_child_open_for_read (void)
+{
+  return 0;
+}
+
+void
+sys_socketpair (int sv[2], bool packets)
+{
+  FATAL_ERROR ((0, 0, _("Cannot use worker processes")));
+}
+
+bool
+sys_send_full (int sock, int const *fds, size_t nfds,
+	       void const *buf, size_t size)
+{
+  errno = ENOSYS;
+  return false;
+}
+
+bool
+sys_recv_full (int sock, int *fds, size_t *nfds, void *buf, size_t size)
+{
+  errno = ENOSYS;
+  return false;
+}
+
+bool
+sys_send_packet (int sock, int fd, void const *buf, size_t size)
+{
+  errno = ENOSYS;
+  return false;
+}
+
+ssize_t
+sys_recv_packet (int sock, int *fd, void *buf, size_t size)
+{
+  errno = ENOSYS;
+  return -1;
+}
+
+bool
+sys_file_extent (int dirfd, char const *name, off_t *offset)
+{
+  return false;
+}
+
+ssize_t
+sys_file_data_extents (int fd, off_t *offset, struct sp_array *map, size_t n,
+		       bool *last)
+{
+  errno = ENOSYS;
+  return -1;
+}
+
+bool
+sys_allocate (int fd, off_t offset, off_t size, bool keep_size)
+{
+  errno = ENOSYS;
+  return false;
+}
+
+bool
+sys_punch_hole (int fd, off_t offset, off_t size)
+{
+  errno = ENOSYS;
+  return false;
+}
+
+size_t
+sys_open_files_max (void)
+{
+  return SIZE_MAX;
+}
+
 #else
 
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#if HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
+#if HAVE_LINUX_FS_H && HAVE_LINUX_FIEMAP_H
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+# include <linux/fiemap.h>
+#endif
+#if HAVE_LINUX_FALLOC_H
+# include <linux/falloc.h>
+#endif
+
 extern union block *record_start; /* FIXME */
 
 static struct stat archive_stat; /* stat block for archive file */
@@ -197,6 +329,23 @@ sys_wait_for_child (pid_t child_pid, bool eof)
     }
 }
 
+/* Terminate the child CHILD_PID, whose output is not needed any more,
+   and wait for it.  */
+void
+sys_kill_child (pid_t child_pid)
+{
+  if (child_pid)
+    {
+      kill (child_pid, SIGKILL);
+      while (waitpid (child_pid, NULL, 0) == -1)
+	if (errno != EINTR)
+	  {
+	    waitpid_error (use_compress_program_option);
+	    break;
+	  }
+    }
+}
+
 void
 sys_spawn_shell (void)
 {
@@ -268,6 +417,209 @@ sys_write_archive_buffer (void)
   return rmtwrite (archive, record_start->buffer, record_size);
 }
 
+/* Return true if the archive is a local regular file.  */
+bool
+sys_archive_is_regular (void)
+{
+  return !_isrmt (archive) && S_ISREG (archive_stat.st_mode);
+}
+
+/* Copy up to SIZE bytes from the current offset of the file open on
+   FD to the current offset of the archive, without passing them
+   through user space.  Return the number of bytes copied, 0 at end
+   of file, or -1 (with errno set) on failure.  */
+ssize_t
+sys_copy_to_archive (int fd, size_t size)
+{
+#if HAVE_COPY_FILE_RANGE
+  /* copy_file_range may share the data extents instead of copying
+     them, but is not supported between all pairs of file systems.  */
+  static bool copy_file_range_works = true;
+
+  if (copy_file_range_works)
+    {
+      ssize_t n = copy_file_range (fd, NULL, archive, NULL, size, 0);
+      if (0 <= n
+	  || ! (errno == ENOSYS || errno == EXDEV || errno == EINVAL
+		|| errno == EOPNOTSUPP))
+	return n;
+      copy_file_range_works = false;
+    }
+#endif
+#if HAVE_SENDFILE && HAVE_SYS_SENDFILE_H
+  return sendfile (archive, fd, NULL, size);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+/* Copy up to SIZE bytes from the current offset of the archive to
+   the current offset of the file open on FD, without passing them
+   through user space.  Return as for sys_copy_to_archive.  */
+ssize_t
+sys_copy_from_archive (int fd, size_t size)
+{
+#if HAVE_SPLICE
+  /* splice works if the archive is a pipe, e.g. from a decompressor.  */
+  ssize_t n = splice (archive, NULL, fd, NULL, size, 0);
+  if (0 <= n || errno != EINVAL)
+    return n;
+#endif
+#if HAVE_COPY_FILE_RANGE
+  return copy_file_range (archive, NULL, fd, NULL, size, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+/* Store into *OFFSET the physical location on disk of the start of the
+   regular file NAME in the directory DIRFD.  Return false if it is not
+   a regular file, or if its location is unknown.  */
+bool
+sys_file_extent (int dirfd, char const *name, off_t *offset)
+{
+#ifdef FS_IOC_FIEMAP
+  struct
+  {
+    struct fiemap map;
+    struct fiemap_extent extent;
+  } request;
+  struct stat st;
+  bool found;
+  int fd;
+
+  if (fstatat (dirfd, name, &st, fstatat_flags) != 0
+      || ! S_ISREG (st.st_mode) || st.st_size == 0)
+    return false;
+  fd = openat (dirfd, name, open_read_flags);
+  if (fd < 0)
+    return false;
+
+  memset (&request, 0, sizeof request);
+  request.map.fm_length = FIEMAP_MAX_OFFSET;
+  request.map.fm_extent_count = 1;
+  found = (ioctl (fd, FS_IOC_FIEMAP, &request.map) == 0
+	   && request.map.fm_mapped_extents == 1
+	   && request.extent.fe_physical <= TYPE_MAXIMUM (off_t));
+  if (found)
+    *offset = request.extent.fe_physical;
+  close (fd);
+  return found;
+#else
+  return false;
+#endif
+}
+
+/* Store into MAP, in increasing order, up to N extents of data of the
+   file FD that lie past *OFFSET, and advance *OFFSET past the extents
+   examined.  Unwritten extents, which read as zeros, are left out.
+   Set *LAST if no extents follow.  Return the number of extents stored,
+   or -1 if the extents of FD cannot be found.  */
+ssize_t
+sys_file_data_extents (int fd, off_t *offset, struct sp_array *map, size_t n,
+		       bool *last)
+{
+#ifdef FS_IOC_FIEMAP
+  static struct fiemap *request;
+  static size_t request_extents;
+  size_t i;
+  size_t stored = 0;
+
+  if (request_extents < n)
+    {
+      free (request);
+      request = xmalloc (offsetof (struct fiemap, fm_extents)
+			 + n * sizeof request->fm_extents[0]);
+      request_extents = n;
+    }
+
+  memset (request, 0, sizeof *request);
+  request->fm_start = *offset;
+  request->fm_length = FIEMAP_MAX_OFFSET - *offset;
+  request->fm_flags = FIEMAP_FLAG_SYNC;
+  request->fm_extent_count = n;
+  if (ioctl (fd, FS_IOC_FIEMAP, request) != 0)
+    return -1;
+
+  *last = request->fm_mapped_extents == 0;
+  for (i = 0; i < request->fm_mapped_extents; i++)
+    {
+      struct fiemap_extent const *e = &request->fm_extents[i];
+      off_t beg, end;
+
+      if (TYPE_MAXIMUM (off_t) < e->fe_logical
+	  || TYPE_MAXIMUM (off_t) - e->fe_logical < e->fe_length)
+	{
+	  errno = EOVERFLOW;
+	  return -1;
+	}
+      beg = e->fe_logical < *offset ? *offset : e->fe_logical;
+      end = e->fe_logical + e->fe_length;
+      if (e->fe_flags & FIEMAP_EXTENT_LAST)
+	*last = true;
+      if (end <= *offset)
+	continue;
+      *offset = end;
+      if (! (e->fe_flags & FIEMAP_EXTENT_UNWRITTEN))
+	{
+	  map[stored].offset = beg;
+	  map[stored].numbytes = end - beg;
+	  stored++;
+	}
+    }
+  return stored;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+/* Allocate disk space for the SIZE bytes at OFFSET in the file FD.
+   Unless KEEP_SIZE, extend the file to cover them.  Return true if
+   successful.  */
+bool
+sys_allocate (int fd, off_t offset, off_t size, bool keep_size)
+{
+#if HAVE_FALLOCATE && defined FALLOC_FL_KEEP_SIZE
+  return (size == 0
+	  || fallocate (fd, keep_size ? FALLOC_FL_KEEP_SIZE : 0,
+			offset, size) == 0);
+#else
+  errno = ENOSYS;
+  return false;
+#endif
+}
+
+/* Free the disk space of the SIZE bytes at OFFSET in the file FD, which
+   then read as zeros.  Return true if successful.  */
+bool
+sys_punch_hole (int fd, off_t offset, off_t size)
+{
+#if HAVE_FALLOCATE && defined FALLOC_FL_PUNCH_HOLE
+  return (size == 0
+	  || fallocate (fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			offset, size) == 0);
+#else
+  errno = ENOSYS;
+  return false;
+#endif
+}
+
+/* Return the number of files that may be open at a time, or SIZE_MAX
+   if it is not limited.  */
+size_t
+sys_open_files_max (void)
+{
+  struct rlimit rlim;
+
+  if (getrlimit (RLIMIT_NOFILE, &rlim) == 0
+      && rlim.rlim_cur != RLIM_INFINITY && rlim.rlim_cur < SIZE_MAX)
+    return rlim.rlim_cur;
+  return SIZE_MAX;
+}
+
 #define	PREAD 0			/* read file descriptor from pipe() */
 #define	PWRITE 1		/* write file descriptor from pipe() */
 
@@ -299,11 +651,11 @@ xdup2 (int from, int into)
     }
 }
 
-static void wait_for_grandchild (pid_t pid) __attribute__ ((__noreturn__));
-
-/* Propagate any failure of the grandchild back to the parent.  */
-static void
-wait_for_grandchild (pid_t pid)
+/* Wait for the process PID.  If it was killed by a signal, kill the
+   current process by the same signal, otherwise return the exit status
+   of PID.  */
+static int
+wait_for_process (pid_t pid)
 {
   int wait_status;
   int exit_code = 0;
@@ -320,153 +672,1126 @@ wait_for_grandchild (pid_t pid)
   else if (WEXITSTATUS (wait_status) != 0)
     exit_code = WEXITSTATUS (wait_status);
 
-  exit (exit_code);
+  return exit_code;
 }
 
-/* Set ARCHIVE for writing, then compressing an archive.  */
-pid_t
-sys_child_open_for_compress (void)
-{
-  int parent_pipe[2];
-  int child_pipe[2];
-  pid_t grandchild_pid;
-  pid_t child_pid;
-
-  signal (SIGPIPE, SIG_IGN);
-  xpipe (parent_pipe);
-  child_pid = xfork ();
+static void wait_for_grandchild (pid_t pid) __attribute__ ((__noreturn__));
 
-  if (child_pid > 0)
-    {
-      /* The parent tar is still here!  Just clean up.  */
+/* Propagate any failure of the grandchild back to the parent.  */
+static void
+wait_for_grandchild (pid_t pid)
+{
+  exit (wait_for_process (pid));
+}
 
-      archive = parent_pipe[PWRITE];
-      xclose (parent_pipe[PREAD]);
-      return child_pid;
-    }
+/* Try to make the pipe FD able to hold SIZE bytes, so that the process
+   at its other end may lag that much behind.  If the system does not
+   allow that large a pipe, settle for the largest possible.  The pipe
+   is never shrunk.  */
+static void
+set_pipe_size (int fd, size_t size)
+{
+#if defined F_GETPIPE_SZ && defined F_SETPIPE_SZ
+  int cur = fcntl (fd, F_GETPIPE_SZ);
 
-  /* The new born child tar is here!  */
+  if (INT_MAX < size)
+    size = INT_MAX;
+  for (; 0 <= cur && (size_t) cur < size; size /= 2)
+    if (fcntl (fd, F_SETPIPE_SZ, (int) size) >= 0 || errno != EPERM)
+      break;
+#endif
+}
 
-  set_program_name (_("tar (child)"));
-  signal (SIGPIPE, SIG_DFL);
+/* Assemble a record read from FD in the record buffer.  Return its
+   length, which is less than record_size only at end of file.  */
+static size_t
+read_record (int fd, char const *input_name)
+{
+  size_t status;
+  char *cursor;
+  size_t length;
 
-  xdup2 (parent_pipe[PREAD], STDIN_FILENO);
-  xclose (parent_pipe[PWRITE]);
+  for (length = 0, cursor = record_start->buffer;
+       length < record_size;
+       length += status, cursor += status)
+    {
+      size_t size = record_size - length;
 
-  /* Check if we need a grandchild tar.  This happens only if either:
-     a) the file is to be accessed by rmt: compressor doesn't know how;
-     b) the file is not a plain file.  */
+      status = safe_read (fd, cursor, size);
+      if (status == SAFE_READ_ERROR)
+	read_fatal (input_name);
+      if (status == 0)
+	break;
+    }
+  return length;
+}
 
-  if (!_remdev (archive_name_array[0])
-      && is_regular_file (archive_name_array[0]))
+/* Read records from FD and write them to the archive, until end of
+   file on FD.  The last record is padded with zeros to the full record
+   size.  */
+static void
+copy_records_to_archive (int fd, char const *input_name)
+{
+  while (1)
     {
-      if (backup_option)
-	maybe_backup_file (archive_name_array[0], 1);
+      size_t status;
+      size_t length = read_record (fd, input_name);
 
-      /* We don't need a grandchild tar.  Open the archive and launch the
-	 compressor.  */
-      if (strcmp (archive_name_array[0], "-"))
+      /* Copy the record.  */
+
+      if (length < record_size)
 	{
-	  archive = creat (archive_name_array[0], MODE_RW);
-	  if (archive < 0)
-	    {
-	      int saved_errno = errno;
+	  /* We hit the end of the file.  Write last record at
+	     full length, as the only role of the caller is
+	     doing proper reblocking.  */
 
-	      if (backup_option)
-		undo_last_backup ();
-	      errno = saved_errno;
-	      open_fatal (archive_name_array[0]);
+	  if (length > 0)
+	    {
+	      memset (record_start->buffer + length, 0, record_size - length);
+	      status = sys_write_archive_buffer ();
+	      if (status != record_size)
+		archive_write_error (status);
 	    }
-	  xdup2 (archive, STDOUT_FILENO);
+
+	  /* There is nothing else to read, break out.  */
+	  break;
 	}
-      priv_set_restore_linkdir ();
-      xexec (use_compress_program_option);
+
+      status = sys_write_archive_buffer ();
+      if (status != record_size)
+	archive_write_error (status);
     }
+}
 
-  /* We do need a grandchild tar.  */
+/* Read the next record of the archive into the record buffer, retrying
+   after read errors as far as archive_read_error allows.  Return its
+   length, or 0 at the end of the archive.  */
+static size_t
+read_archive_record (void)
+{
+  size_t status;
 
-  xpipe (child_pipe);
-  grandchild_pid = xfork ();
+  clear_read_error_count ();
+  while ((status = rmtread (archive, record_start->buffer, record_size))
+	 == SAFE_READ_ERROR)
+    archive_read_error ();
+  return status;
+}
 
-  if (grandchild_pid == 0)
+/* Read the archive until its end and write its contents to FD.  */
+static void
+copy_archive_to (int fd, char const *output_name)
+{
+  while (1)
     {
-      /* The newborn grandchild tar is here!  Launch the compressor.  */
+      char *cursor;
+      size_t maximum;
+      size_t count;
+      size_t status = read_archive_record ();
 
-      set_program_name (_("tar (grandchild)"));
+      if (status == 0)
+	break;
+      cursor = record_start->buffer;
+      maximum = status;
+      while (maximum)
+	{
+	  count = maximum < BLOCKSIZE ? maximum : BLOCKSIZE;
+	  if (full_write (fd, cursor, count) != count)
+	    write_error (output_name);
+	  cursor += count;
+	  maximum -= count;
+	}
+    }
+}
 
-      xdup2 (child_pipe[PWRITE], STDOUT_FILENO);
-      xclose (child_pipe[PREAD]);
-      priv_set_restore_linkdir ();
-      xexec (use_compress_program_option);
+/* A frame is about to be written to standard output.  If *FRAME_FD is
+   nonnegative, write to it the current offset of the output, as a
+   decimal number on a line of its own.  If the output is not seekable,
+   give up recording the offsets and set *FRAME_FD to -1.  */
+static void
+write_frame_offset (int *frame_fd)
+{
+  off_t offset;
+  char buf[UINTMAX_STRSIZE_BOUND];
+  char *p;
+  size_t size;
+
+  if (*frame_fd < 0)
+    return;
+
+  offset = lseek (STDOUT_FILENO, 0, SEEK_CUR);
+  if (offset < 0)
+    {
+      xclose (*frame_fd);
+      *frame_fd = -1;
+      return;
     }
 
-  /* The child tar is still here!  */
+  p = umaxtostr (offset, buf);
+  buf[sizeof buf - 1] = '\n';
+  size = buf + sizeof buf - p;
+  if (full_write (*frame_fd, p, size) != size)
+    {
+      write_error (_("frame table"));
+      fatal_exit ();
+    }
+}
 
-  /* Prepare for reblocking the data from the compressor into the archive.  */
+/* Compress the records read from standard input to standard output,
+   restarting the compression program every frame_size_option bytes so
+   that each frame can be decompressed on its own.  If FRAME_FD is
+   nonnegative, write to it the offset of each frame in the output, for
+   as long as the output is seekable.  */
+static _Noreturn void
+compress_frames (int frame_fd)
+{
+  size_t length = read_record (STDIN_FILENO, _("(pipe)"));
 
-  xdup2 (child_pipe[PREAD], STDIN_FILENO);
-  xclose (child_pipe[PWRITE]);
+  while (length)
+    {
+      int frame_pipe[2];
+      pid_t pid;
+      off_t left = frame_size_option;
+      int exit_code;
+
+      write_frame_offset (&frame_fd);
+      xpipe (frame_pipe);
+      pid = xfork ();
+      if (pid == 0)
+	{
+	  xdup2 (frame_pipe[PREAD], STDIN_FILENO);
+	  xclose (frame_pipe[PWRITE]);
+	  xexec (use_compress_program_option);
+	}
+      xclose (frame_pipe[PREAD]);
 
-  if (strcmp (archive_name_array[0], "-") == 0)
-    archive = STDOUT_FILENO;
-  else
+      do
+	{
+	  if (full_write (frame_pipe[PWRITE], record_start->buffer, length)
+	      != length)
+	    {
+	      write_error (use_compress_program_option);
+	      fatal_exit ();
+	    }
+	  left -= length;
+	  length = read_record (STDIN_FILENO, _("(pipe)"));
+	}
+      while (length && left);
+
+      xclose (frame_pipe[PWRITE]);
+      exit_code = wait_for_process (pid);
+      if (exit_code != 0)
+	exit (exit_code);
+    }
+
+  exit (TAREXIT_SUCCESS);
+}
+
+/* Maximum number of bytes of its frame, and of its output, that are
+   kept in memory for each frame filtered in parallel with others,
+   whatever the frame size.  Of a larger frame, only the last this many
+   bytes are read in ahead of its program; the frames after it start
+   once they are.  */
+#define FRAME_BUFFER_MAX (16 * 1024 * 1024)
+
+/* A frame being compressed or decompressed in parallel with others.  */
+struct frame_job
+{
+  pid_t pid;			/* Process running the filter program */
+  int in;			/* Input of the program, or -1 once written */
+  char *input;			/* Part of the frame read in */
+  size_t input_size;		/* Number of bytes in INPUT */
+  size_t input_written;		/* Number of them written so far */
+  bool input_end;		/* True if INPUT ends the frame */
+  int fd;			/* Output of the program, or -1 at its end */
+  char *buffer;			/* Output received before its turn */
+  size_t size;			/* Number of bytes in BUFFER */
+  size_t allocated;		/* Allocated size of BUFFER */
+  size_t in_poll;		/* Index of IN in the poll array */
+  size_t fd_poll;		/* Index of FD in the poll array */
+};
+
+/* Read into BUF up to SIZE bytes from standard input, which is named
+   INPUT_NAME.  Return the number of bytes read, which is less than SIZE
+   only at end of file.  */
+static size_t
+read_frame (char *buf, size_t size, char const *input_name)
+{
+  size_t length = 0;
+
+  while (length < size)
     {
-      archive = rmtcreat (archive_name_array[0], MODE_RW, rsh_command_option);
-      if (archive < 0)
-	open_fatal (archive_name_array[0]);
+      size_t status = safe_read (STDIN_FILENO, buf + length, size - length);
+      if (status == SAFE_READ_ERROR)
+	read_fatal (input_name);
+      if (status == 0)
+	break;
+      length += status;
     }
+  return length;
+}
 
-  /* Let's read out of the stdin pipe and write an archive.  */
+/* Start a process that runs PROGRAM on the frame of JOB, which is one
+   of the COUNT jobs at JOBS.  PROGRAM must filter standard input to
+   standard output.  The frame is written to the program by the caller,
+   as the program is ready to take it.  */
+static void
+start_frame_job (struct frame_job *job, struct frame_job const *jobs,
+		 size_t count, void (*program) (void))
+{
+  int input_pipe[2];
+  int output_pipe[2];
 
-  while (1)
+  xpipe (input_pipe);
+  xpipe (output_pipe);
+
+  /* Keep the programs of the other frames from inheriting our ends of
+     the pipes, lest their input never end.  */
+  fcntl (input_pipe[PWRITE], F_SETFD, FD_CLOEXEC);
+  fcntl (output_pipe[PREAD], F_SETFD, FD_CLOEXEC);
+
+  job->pid = xfork ();
+  if (job->pid == 0)
     {
-      size_t status = 0;
-      char *cursor;
-      size_t length;
+      /* PROGRAM need not execute another program, so close the pipes
+	 of the other jobs right away.  */
+      size_t i;
+      for (i = 0; i < count; i++)
+	if (&jobs[i] != job)
+	  {
+	    if (0 <= jobs[i].in)
+	      xclose (jobs[i].in);
+	    if (0 <= jobs[i].fd)
+	      xclose (jobs[i].fd);
+	  }
 
-      /* Assemble a record.  */
+      xdup2 (input_pipe[PREAD], STDIN_FILENO);
+      xclose (input_pipe[PWRITE]);
+      xdup2 (output_pipe[PWRITE], STDOUT_FILENO);
+      xclose (output_pipe[PREAD]);
+      program ();
+    }
+
+  xclose (input_pipe[PREAD]);
+  xclose (output_pipe[PWRITE]);
+  fcntl (input_pipe[PWRITE], F_SETFL,
+	 fcntl (input_pipe[PWRITE], F_GETFL) | O_NONBLOCK);
+  job->in = input_pipe[PWRITE];
+  job->fd = output_pipe[PREAD];
+  job->size = 0;
+}
 
-      for (length = 0, cursor = record_start->buffer;
-	   length < record_size;
-	   length += status, cursor += status)
+/* Read into the buffer of JOB, which holds SIZE bytes, the next part
+   of its frame, using READ_NEXT as filter_frames_in_parallel does.
+   START is true for the first part.  Return the number of bytes
+   read.  */
+static size_t
+read_frame_job (struct frame_job *job,
+		size_t (*read_next) (char *, size_t, bool),
+		size_t size, bool start)
+{
+  job->input_size = read_next (job->input, size, start);
+  job->input_written = 0;
+  job->input_end = job->input_size < size;
+  return job->input_size;
+}
+
+/* Write to the program of JOB as much of the part of its frame read in
+   as it takes without blocking, and end its input after the end of the
+   frame.  FILTER_NAME is used in diagnostics.  */
+static void
+feed_frame_job (struct frame_job *job, char const *filter_name)
+{
+  if (job->input_written < job->input_size)
+    {
+      ssize_t n = write (job->in, job->input + job->input_written,
+			 job->input_size - job->input_written);
+      if (n < 0)
 	{
-	  size_t size = record_size - length;
+	  if (errno == EAGAIN || errno == EINTR)
+	    return;
+	  write_error (filter_name);
+	  fatal_exit ();
+	}
+      job->input_written += n;
+    }
+  if (job->input_written == job->input_size && job->input_end)
+    {
+      xclose (job->in);
+      job->in = -1;
+    }
+}
 
-	  status = safe_read (STDIN_FILENO, cursor, size);
-	  if (status == SAFE_READ_ERROR)
-	    read_fatal (use_compress_program_option);
-	  if (status == 0)
+/* Write SIZE bytes at BUF to standard output, which is named
+   OUTPUT_NAME.  */
+static void
+write_frame_output (char const *buf, size_t size, char const *output_name)
+{
+  if (full_write (STDOUT_FILENO, buf, size) != size)
+    {
+      write_error (output_name);
+      fatal_exit ();
+    }
+}
+
+/* Run up to compress_workers_option copies of PROGRAM at a time, each
+   of them filtering one frame, and write their outputs to standard
+   output in the order of the frames.  READ_NEXT reads from standard
+   input into a buffer of the given size the next bytes of the current
+   frame, or of the next frame if its last argument is true, and
+   returns their number, which is less than the size only at the end of
+   the frame, and 0 at the start of a frame only at the end of the
+   input.  INPUT_MAX is the size of the buffer to use, at most
+   FRAME_BUFFER_MAX.  If FRAME_FD is not null, record the offset of
+   each output frame in it as write_frame_offset does.  FILTER_NAME and
+   OUTPUT_NAME are used in diagnostics.  */
+static _Noreturn void
+filter_frames_in_parallel (size_t (*read_next) (char *, size_t, bool),
+			   size_t input_max,
+			   void (*program) (void), char const *filter_name,
+			   char const *output_name, int *frame_fd)
+{
+  size_t workers = compress_workers_option;
+  struct frame_job *jobs = xcalloc (workers, sizeof *jobs);
+  struct pollfd *fds = xnmalloc (workers, 2 * sizeof *fds);
+  char *chunk = xmalloc (record_size);
+  size_t head = 0;		/* First frame not written yet */
+  size_t tail = 0;		/* First frame not started yet */
+  bool eof = false;
+  size_t i;
+
+  for (i = 0; i < workers; i++)
+    jobs[i].in = jobs[i].fd = -1;
+
+  for (;;)
+    {
+      size_t nfds = 0;
+
+      /* Read on into the last frame started, once its program has
+	 taken what was read of it so far.  */
+      if (head < tail)
+	{
+	  struct frame_job *job = &jobs[(tail - 1) % workers];
+	  if (0 <= job->in && ! job->input_end
+	      && job->input_written == job->input_size
+	      && read_frame_job (job, read_next, input_max, false) == 0)
+	    {
+	      xclose (job->in);
+	      job->in = -1;
+	    }
+	}
+
+      /* Start filtering as many frames as there are free workers,
+	 once the frames before them are read in in full.  */
+      while (! eof && tail - head < workers
+	     && (head == tail || jobs[(tail - 1) % workers].input_end))
+	{
+	  struct frame_job *job = &jobs[tail % workers];
+	  if (! job->input)
+	    job->input = xmalloc (input_max);
+	  if (read_frame_job (job, read_next, input_max, true) == 0)
+	    {
+	      eof = true;
+	      break;
+	    }
+	  if (head == tail && frame_fd)
+	    write_frame_offset (frame_fd);
+	  start_frame_job (job, jobs, workers, program);
+	  tail++;
+	}
+
+      /* Write the frames that are complete, in order.  */
+      while (head < tail
+	     && jobs[head % workers].in < 0 && jobs[head % workers].fd < 0)
+	{
+	  int exit_code = wait_for_process (jobs[head % workers].pid);
+	  if (exit_code != 0)
+	    exit (exit_code);
+	  head++;
+	  if (head < tail)
+	    {
+	      struct frame_job *job = &jobs[head % workers];
+	      if (frame_fd)
+		write_frame_offset (frame_fd);
+	      write_frame_output (job->buffer, job->size, output_name);
+	      job->size = 0;
+	    }
+	}
+
+      if (head == tail)
+	{
+	  if (eof)
 	    break;
+	  continue;
 	}
 
-      /* Copy the record.  */
+      /* Feed the running jobs their frames and collect their output.
+	 The output of the first frame is written right away, that of
+	 the others is kept until their turn, up to FRAME_BUFFER_MAX
+	 bytes; beyond that, their programs wait.  */
+      for (i = head; i < tail; i++)
+	{
+	  struct frame_job *job = &jobs[i % workers];
+	  if (0 <= job->in && job->input_written < job->input_size)
+	    {
+	      job->in_poll = nfds;
+	      fds[nfds].fd = job->in;
+	      fds[nfds].events = POLLOUT;
+	      nfds++;
+	    }
+	  if (0 <= job->fd && (i == head || job->size < FRAME_BUFFER_MAX))
+	    {
+	      job->fd_poll = nfds;
+	      fds[nfds].fd = job->fd;
+	      fds[nfds].events = POLLIN;
+	      nfds++;
+	    }
+	  else
+	    job->fd_poll = SIZE_MAX;
+	}
+      while (poll (fds, nfds, -1) < 0)
+	if (errno != EINTR)
+	  call_arg_fatal ("poll", filter_name);
 
-      if (status == 0)
+      for (i = head; i < tail; i++)
 	{
-	  /* We hit the end of the file.  Write last record at
-	     full length, as the only role of the grandchild is
-	     doing proper reblocking.  */
+	  struct frame_job *job = &jobs[i % workers];
+	  size_t status;
 
-	  if (length > 0)
+	  if (0 <= job->in && job->input_written < job->input_size
+	      && fds[job->in_poll].revents)
+	    feed_frame_job (job, filter_name);
+	  if (job->fd < 0 || job->fd_poll == SIZE_MAX
+	      || ! fds[job->fd_poll].revents)
+	    continue;
+
+	  if (i == head)
 	    {
-	      memset (record_start->buffer + length, 0, record_size - length);
-	      status = sys_write_archive_buffer ();
-	      if (status != record_size)
-		archive_write_error (status);
+	      status = safe_read (job->fd, chunk, record_size);
+	      if (status != SAFE_READ_ERROR)
+		write_frame_output (chunk, status, output_name);
 	    }
+	  else
+	    {
+	      if (job->allocated - job->size < record_size)
+		{
+		  job->allocated = job->size + record_size;
+		  job->buffer = x2realloc (job->buffer, &job->allocated);
+		}
+	      status = safe_read (job->fd, job->buffer + job->size,
+				  record_size);
+	      if (status != SAFE_READ_ERROR)
+		job->size += status;
+	    }
+	  if (status == SAFE_READ_ERROR)
+	    read_fatal (filter_name);
+	  if (status == 0)
+	    {
+	      xclose (job->fd);
+	      job->fd = -1;
+	    }
+	}
+    }
 
-	  /* There is nothing else to read, break out.  */
-	  break;
+  exit (TAREXIT_SUCCESS);
+}
+
+/* Number of bytes left in the frame being read by read_next.  */
+static off_t frame_left;
+
+/* Read the next bytes of the archive to compress, in frames of
+   frame_size_option bytes, as filter_frames_in_parallel wants.  */
+static size_t
+read_uncompressed_frame (char *buf, size_t size, bool start)
+{
+  size_t length;
+
+  if (start)
+    frame_left = frame_size_option;
+  if (frame_left < (off_t) size)
+    size = frame_left;
+  length = read_frame (buf, size, _("(pipe)"));
+  frame_left -= length;
+  return length;
+}
+
+static void
+exec_compress_program (void)
+{
+  xexec (use_compress_program_option);
+}
+
+/* The library that compresses the archive instead of the compression
+   program, or codec_none.  */
+static enum codec_format compress_codec;
+
+/* Name of standard output, for diagnostics.  */
+static char const *compressed_output_name;
+
+/* Write SIZE bytes of compressed data at BUF to standard output.  */
+static void
+write_compressed (char const *buf, size_t size)
+{
+  write_frame_output (buf, size, compressed_output_name);
+}
+
+/* Number of bytes of compressed data collected in the record buffer.  */
+static size_t compressed_record_size;
+
+/* Collect SIZE bytes of compressed data at BUF in the record buffer,
+   and write it to the archive whenever it fills up.  */
+static void
+write_compressed_records (char const *buf, size_t size)
+{
+  while (size)
+    {
+      size_t n = min (size, record_size - compressed_record_size);
+      memcpy (record_start->buffer + compressed_record_size, buf, n);
+      compressed_record_size += n;
+      buf += n;
+      size -= n;
+      if (compressed_record_size == record_size)
+	{
+	  size_t status = sys_write_archive_buffer ();
+	  if (status != record_size)
+	    archive_write_error (status);
+	  compressed_record_size = 0;
 	}
+    }
+}
 
+/* Write the compressed data left in the record buffer to the archive,
+   padded with zeros to the full record size.  */
+static void
+flush_compressed_records (void)
+{
+  if (compressed_record_size)
+    {
+      size_t status;
+      memset (record_start->buffer + compressed_record_size, 0,
+	      record_size - compressed_record_size);
       status = sys_write_archive_buffer ();
       if (status != record_size)
 	archive_write_error (status);
+      compressed_record_size = 0;
+    }
+}
+
+/* Compress standard input with the library compress_codec, and pass
+   the compressed data to OUTPUT.  Restart compression every
+   frame_size_option bytes like compress_frames, and record the offsets
+   of the frames in FRAME_FD the same way.  */
+static void
+compress_with_library (int frame_fd, void (*output) (char const *, size_t))
+{
+  char *buf = xmalloc (record_size);
+  size_t length = read_frame (buf, record_size, _("(pipe)"));
+
+  while (length)
+    {
+      struct codec *c = compressor_open (compress_codec);
+      off_t left = frame_size_option;
+
+      if (frame_size_option)
+	write_frame_offset (&frame_fd);
+      do
+	{
+	  compressor_write (c, buf, length, output);
+	  left -= length;
+	  length = read_frame (buf, record_size, _("(pipe)"));
+	}
+      while (length && (! frame_size_option || left));
+      compressor_close (c, output);
+    }
+  free (buf);
+}
+
+/* Compress a frame handed over by filter_frames_in_parallel with the
+   library.  */
+static void
+compress_frame_with_library (void)
+{
+  compressed_output_name = _("(pipe)");
+  compress_with_library (-1, write_compressed);
+  exit (TAREXIT_SUCCESS);
+}
+
+/* Compress the archive like compress_frames, but up to
+   compress_workers_option frames at a time.  */
+static _Noreturn void
+compress_frames_in_parallel (int frame_fd)
+{
+  filter_frames_in_parallel (read_uncompressed_frame,
+			     min (frame_size_option, FRAME_BUFFER_MAX),
+			     (compress_codec
+			      ? compress_frame_with_library
+			      : exec_compress_program),
+			     use_compress_program_option,
+			     archive_name_array[0], &frame_fd);
+}
+
+/* Compress standard input to standard output, either in frames or as
+   a single stream.  */
+static _Noreturn void
+run_compress_program (int frame_fd)
+{
+  priv_set_restore_linkdir ();
+  if (frame_size_option && 1 < compress_workers_option)
+    compress_frames_in_parallel (frame_fd);
+  if (compress_codec)
+    {
+      compressed_output_name = archive_name_array[0];
+      compress_with_library (frame_fd, write_compressed);
+      exit (TAREXIT_SUCCESS);
+    }
+  if (frame_size_option)
+    compress_frames (frame_fd);
+  xexec (use_compress_program_option);
+}
+
+/* Open the archive that the compressed records are written to, when it
+   is not a local regular file.  */
+static void
+open_compressed_archive (void)
+{
+  if (strcmp (archive_name_array[0], "-") == 0)
+    archive = STDOUT_FILENO;
+  else
+    {
+      archive = rmtcreat (archive_name_array[0], MODE_RW, rsh_command_option);
+      if (archive < 0)
+	open_fatal (archive_name_array[0]);
+    }
+}
+
+/* Set ARCHIVE for writing, then compressing an archive.  */
+pid_t
+sys_child_open_for_compress (void)
+{
+  int parent_pipe[2];
+  int child_pipe[2];
+  pid_t grandchild_pid;
+  pid_t child_pid;
+  int frame_fd = index_frames_fd ();
+
+  signal (SIGPIPE, SIG_IGN);
+  xpipe (parent_pipe);
+  if (write_queue_option)
+    set_pipe_size (parent_pipe[PWRITE], write_queue_option * record_size);
+  child_pid = xfork ();
+
+  if (child_pid > 0)
+    {
+      /* The parent tar is still here!  Just clean up.  */
+
+      archive = parent_pipe[PWRITE];
+      xclose (parent_pipe[PREAD]);
+      return child_pid;
+    }
+
+  /* The new born child tar is here!  */
+
+  set_program_name (_("tar (child)"));
+  signal (SIGPIPE, SIG_DFL);
+
+  xdup2 (parent_pipe[PREAD], STDIN_FILENO);
+  xclose (parent_pipe[PWRITE]);
+
+  compress_codec = codec_for_program (use_compress_program_option);
+
+  /* Check if we need a grandchild tar.  This happens only if either:
+     a) the file is to be accessed by rmt: compressor doesn't know how;
+     b) the file is not a plain file.  */
+
+  if (!_remdev (archive_name_array[0])
+      && is_regular_file (archive_name_array[0]))
+    {
+      if (backup_option)
+	maybe_backup_file (archive_name_array[0], 1);
+
+      /* We don't need a grandchild tar.  Open the archive and launch the
+	 compressor.  */
+      if (strcmp (archive_name_array[0], "-"))
+	{
+	  archive = creat (archive_name_array[0], MODE_RW);
+	  if (archive < 0)
+	    {
+	      int saved_errno = errno;
+
+	      if (backup_option)
+		undo_last_backup ();
+	      errno = saved_errno;
+	      open_fatal (archive_name_array[0]);
+	    }
+	  xdup2 (archive, STDOUT_FILENO);
+	}
+      run_compress_program (frame_fd);
+    }
+
+  /* A library compresses right here, into the records of the archive,
+     unless frames are compressed in parallel.  Frame offsets are not
+     recorded, as they would not be by a grandchild.  */
+
+  if (compress_codec && ! (frame_size_option && 1 < compress_workers_option))
+    {
+      if (0 <= frame_fd)
+	xclose (frame_fd);
+      open_compressed_archive ();
+      compress_with_library (-1, write_compressed_records);
+      flush_compressed_records ();
+      exit (TAREXIT_SUCCESS);
     }
 
+  /* We do need a grandchild tar.  */
+
+  xpipe (child_pipe);
+  grandchild_pid = xfork ();
+
+  if (grandchild_pid == 0)
+    {
+      /* The newborn grandchild tar is here!  Launch the compressor.  */
+
+      set_program_name (_("tar (grandchild)"));
+
+      xdup2 (child_pipe[PWRITE], STDOUT_FILENO);
+      xclose (child_pipe[PREAD]);
+      run_compress_program (frame_fd);
+    }
+
+  /* The child tar is still here!  */
+
+  /* Prepare for reblocking the data from the compressor into the archive.  */
+
+  xdup2 (child_pipe[PREAD], STDIN_FILENO);
+  xclose (child_pipe[PWRITE]);
+
+  open_compressed_archive ();
+
+  /* Let's read out of the stdin pipe and write an archive.  */
+
+  copy_records_to_archive (STDIN_FILENO, use_compress_program_option);
+
   wait_for_grandchild (grandchild_pid);
 }
 
+/* Interpose a writer process between tar and the archive, which has
+   already been opened as ARCHIVE.  Tar writes records into a pipe able
+   to hold write_queue_option of them, and the writer copies them to
+   the archive, so that writing the archive overlaps with reading the
+   files being archived.  */
+pid_t
+sys_child_open_for_write (void)
+{
+  int parent_pipe[2];
+  pid_t child_pid;
+
+  signal (SIGPIPE, SIG_IGN);
+  xpipe (parent_pipe);
+  set_pipe_size (parent_pipe[PWRITE], write_queue_option * record_size);
+  child_pid = xfork ();
+
+  if (child_pid > 0)
+    {
+      /* The parent tar is still here!  Just clean up.  Standard output
+	 is left open, lest its descriptor be reused.  */
+
+      if (archive != STDOUT_FILENO)
+	xclose (archive);
+      archive = parent_pipe[PWRITE];
+      xclose (parent_pipe[PREAD]);
+      return child_pid;
+    }
+
+  /* The new born child tar is here!  */
+
+  set_program_name (_("tar (child)"));
+  signal (SIGPIPE, SIG_DFL);
+  xclose (parent_pipe[PWRITE]);
+  exit_status = TAREXIT_SUCCESS;
+
+  copy_records_to_archive (parent_pipe[PREAD], _("(pipe)"));
+
+  if (close (archive) != 0)
+    close_error (*archive_name_cursor);
+  exit (exit_status);
+}
+
+/* Arrange for up to read_queue_option records of the archive, which
+   has already been opened as ARCHIVE, to be read ahead of tar.  If the
+   archive is a pipe, merely enlarge it.  If it is a regular file, let
+   the system read it ahead.  Otherwise, interpose a reader process
+   that copies the archive into a pipe.  Return the PID of the reader,
+   or 0 if none was needed.  */
+pid_t
+sys_child_open_for_read (void)
+{
+  int parent_pipe[2];
+  pid_t child_pid;
+
+  if (S_ISFIFO (archive_stat.st_mode))
+    {
+      set_pipe_size (archive, read_queue_option * record_size);
+      return 0;
+    }
+
+  if (S_ISREG (archive_stat.st_mode))
+    {
+#ifdef POSIX_FADV_SEQUENTIAL
+      posix_fadvise (archive, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+      return 0;
+    }
+
+  xpipe (parent_pipe);
+  set_pipe_size (parent_pipe[PREAD], read_queue_option * record_size);
+  child_pid = xfork ();
+
+  if (child_pid > 0)
+    {
+      /* The parent tar is still here!  Just clean up.  Standard input
+	 is left open, lest its descriptor be reused.  */
+
+      if (archive != STDIN_FILENO)
+	xclose (archive);
+      archive = parent_pipe[PREAD];
+      xclose (parent_pipe[PWRITE]);
+      return child_pid;
+    }
+
+  /* The newborn child tar is here!  */
+
+  set_program_name (_("tar (child)"));
+  signal (SIGPIPE, SIG_DFL);
+  xclose (parent_pipe[PREAD]);
+  exit_status = TAREXIT_SUCCESS;
+
+  copy_archive_to (parent_pipe[PWRITE], _("(pipe)"));
+
+  exit (exit_status);
+}
+
+/* Create a pair of connected local sockets in SV.  If PACKETS, they
+   preserve message boundaries (SOCK_SEQPACKET), otherwise they carry
+   a byte stream.  */
+void
+sys_socketpair (int sv[2], bool packets)
+{
+  if (socketpair (AF_UNIX, packets ? SOCK_SEQPACKET : SOCK_STREAM, 0, sv) < 0)
+    call_arg_fatal ("socketpair", _("interprocess channel"));
+}
+
+/* Send at most SIZE bytes from BUF over the local socket SOCK, along
+   with the NFDS descriptors in FDS, using the sendmsg FLAGS.  Return
+   the number of bytes sent, or -1 (with errno set) on failure.  */
+static ssize_t
+send_with_fds (int sock, int const *fds, size_t nfds,
+	       void const *buf, size_t size, int flags)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  union
+  {
+    struct cmsghdr h;
+    char buf[CMSG_SPACE (SYS_FDS_MAX * sizeof (int))];
+  } control;
+  struct cmsghdr *cmsg;
+  ssize_t n;
+
+  if (SYS_FDS_MAX < nfds)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  iov.iov_base = (void *) buf;
+  iov.iov_len = size;
+  memset (&msg, 0, sizeof msg);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = CMSG_SPACE (nfds * sizeof *fds);
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (nfds * sizeof *fds);
+  memcpy (CMSG_DATA (cmsg), fds, nfds * sizeof *fds);
+
+  while ((n = sendmsg (sock, &msg, flags)) < 0)
+    if (errno != EINTR)
+      break;
+  return n;
+}
+
+/* Send SIZE bytes from BUF over the local socket SOCK.  Pass the NFDS
+   descriptors in FDS, at most SYS_FDS_MAX of them, along with the
+   first byte.  Return true if successful, false (with errno set)
+   otherwise.  */
+bool
+sys_send_full (int sock, int const *fds, size_t nfds,
+	       void const *buf, size_t size)
+{
+  char const *p = buf;
+
+  if (nfds && size)
+    {
+      ssize_t n = send_with_fds (sock, fds, nfds, p, size, MSG_NOSIGNAL);
+      if (n < 0)
+	return false;
+      p += n;
+      size -= n;
+    }
+
+  while (size)
+    {
+      ssize_t n = send (sock, p, size, MSG_NOSIGNAL);
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return false;
+	}
+      p += n;
+      size -= n;
+    }
+  return true;
+}
+
+/* Receive SIZE bytes into BUF from the local socket SOCK.  If FDS is
+   not null, store in it the descriptors passed along with the first
+   byte, and their number in *NFDS, which on entry is the number of
+   descriptors FDS can hold.  Return true if successful, false on
+   error or premature end of file.  More descriptors than FDS can hold
+   count as an error.  */
+bool
+sys_recv_full (int sock, int *fds, size_t *nfds, void *buf, size_t size)
+{
+  char *p = buf;
+
+  if (fds)
+    {
+      size_t room = min (*nfds, SYS_FDS_MAX);
+
+      *nfds = 0;
+      if (size)
+	{
+	  struct msghdr msg;
+	  struct iovec iov;
+	  union
+	  {
+	    struct cmsghdr h;
+	    char buf[CMSG_SPACE (SYS_FDS_MAX * sizeof (int))];
+	  } control;
+	  struct cmsghdr *cmsg;
+	  ssize_t n;
+
+	  iov.iov_base = p;
+	  iov.iov_len = size;
+	  memset (&msg, 0, sizeof msg);
+	  msg.msg_iov = &iov;
+	  msg.msg_iovlen = 1;
+	  msg.msg_control = control.buf;
+	  msg.msg_controllen = CMSG_SPACE (room * sizeof *fds);
+
+	  while ((n = recvmsg (sock, &msg, MSG_CMSG_CLOEXEC)) < 0)
+	    if (errno != EINTR)
+	      return false;
+	  if (n == 0)
+	    return false;
+	  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg;
+	       cmsg = CMSG_NXTHDR (&msg, cmsg))
+	    if (cmsg->cmsg_level == SOL_SOCKET
+		&& cmsg->cmsg_type == SCM_RIGHTS)
+	      {
+		size_t count = ((cmsg->cmsg_len - CMSG_LEN (0))
+				/ sizeof *fds);
+		memcpy (fds, CMSG_DATA (cmsg), count * sizeof *fds);
+		*nfds = count;
+	      }
+	  if (msg.msg_flags & MSG_CTRUNC)
+	    {
+	      errno = EMSGSIZE;
+	      return false;
+	    }
+	  p += n;
+	  size -= n;
+	}
+    }
+
+  while (size)
+    {
+      ssize_t n = recv (sock, p, size, 0);
+      if (n <= 0)
+	{
+	  if (n < 0 && errno == EINTR)
+	    continue;
+	  return false;
+	}
+      p += n;
+      size -= n;
+    }
+  return true;
+}
+
+/* Send the SIZE bytes from BUF as a single packet over the local
+   packet socket SOCK, along with the descriptor FD if it is
+   nonnegative.  Do not wait for room in the socket: return false
+   (with errno set) if the packet cannot be sent right away.  */
+bool
+sys_send_packet (int sock, int fd, void const *buf, size_t size)
+{
+  ssize_t n;
+
+  if (0 <= fd)
+    n = send_with_fds (sock, &fd, 1, buf, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+  else
+    while ((n = send (sock, buf, size, MSG_NOSIGNAL | MSG_DONTWAIT)) < 0
+	   && errno == EINTR)
+      continue;
+  return n == size;
+}
+
+/* Receive a packet of at most SIZE bytes into BUF from the local
+   socket SOCK, which is of type SOCK_SEQPACKET.  Store in *FD the
+   descriptor passed along with it, or -1 if there is none.  Return
+   the size of the packet, 0 at end of file, or -1 (with errno set) on
+   failure.  A packet longer than SIZE is discarded, and fails with
+   errno set to EMSGSIZE.  */
+ssize_t
+sys_recv_packet (int sock, int *fd, void *buf, size_t size)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  union
+  {
+    struct cmsghdr h;
+    char buf[CMSG_SPACE (sizeof *fd)];
+  } control;
+  struct cmsghdr *cmsg;
+  ssize_t n;
+
+  iov.iov_base = buf;
+  iov.iov_len = size;
+  memset (&msg, 0, sizeof msg);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof control.buf;
+
+  *fd = -1;
+  while ((n = recvmsg (sock, &msg, MSG_CMSG_CLOEXEC)) < 0)
+    if (errno != EINTR)
+      return n;
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg))
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+      memcpy (fd, CMSG_DATA (cmsg), sizeof *fd);
+  if (msg.msg_flags & MSG_TRUNC)
+    {
+      errno = EMSGSIZE;
+      return -1;
+    }
+  return n;
+}
+
 static void
 run_decompress_program (void)
 {
@@ -503,16 +1828,174 @@ run_decompress_program (void)
   exec_fatal (prog);
 }
 
-/* Set ARCHIVE for uncompressing, then reading an archive.  */
+/* The library that decompresses the archive instead of the
+   decompression program, or codec_none.  */
+static enum codec_format decompress_codec;
+
+/* Write SIZE bytes of decompressed data at BUF to standard output.  */
+static void
+write_decompressed (char const *buf, size_t size)
+{
+  write_frame_output (buf, size, _("(pipe)"));
+}
+
+/* Decompress the archive with C until its end, write the decompressed
+   data to standard output, and free C.  */
+static void
+decompress_with_library (struct codec *c)
+{
+  size_t status;
+
+  while ((status = read_archive_record ()) != 0)
+    decompressor_write (c, record_start->buffer, status, write_decompressed);
+  decompressor_close (c);
+}
+
+/* Parts of the compressed archive to decompress in parallel, and the
+   number of parts left.  A part whose size is TYPE_MAXIMUM (off_t)
+   extends to the end of the archive.  */
+static struct codec_frame const *compressed_frames;
+static size_t compressed_frame_count;
+
+/* The xz check of the blocks of the part being read, or -1 if it is
+   made of whole streams or frames.  */
+static int frame_check;
+
+/* True if the part being read extends to the end of the archive.  */
+static bool frame_to_end;
+
+/* Read the next bytes of the compressed archive, part by part, as
+   filter_frames_in_parallel wants.  */
+static size_t
+read_compressed_frame (char *buf, size_t size, bool start)
+{
+  size_t length;
+
+  if (start)
+    {
+      off_t offset;
+
+      if (compressed_frame_count == 0)
+	return 0;
+      offset = compressed_frames->offset;
+      if (lseek (STDIN_FILENO, offset, SEEK_SET) != offset)
+	{
+	  seek_error_details (archive_name_array[0], offset);
+	  fatal_exit ();
+	}
+      frame_left = compressed_frames->size;
+      frame_check = compressed_frames->check;
+      frame_to_end = frame_left == TYPE_MAXIMUM (off_t);
+      compressed_frames++;
+      compressed_frame_count--;
+    }
+
+  if (frame_left < (off_t) size)
+    size = frame_left;
+  length = read_frame (buf, size, archive_name_array[0]);
+  if (length < size && ! frame_to_end)
+    FATAL_ERROR ((0, 0, _("%s: Unexpected EOF in archive"),
+		  quotearg_colon (archive_name_array[0])));
+  frame_left -= length;
+  return length;
+}
+
+/* Decompress a part of the archive handed over by
+   filter_frames_in_parallel, with the library if possible.  */
+static void
+decompress_frame (void)
+{
+  archive = STDIN_FILENO;
+  if (0 <= frame_check)
+    decompress_with_library (xz_blocks_decompressor_open (frame_check));
+  else if (decompress_codec)
+    decompress_with_library (decompressor_open (decompress_codec));
+  else
+    run_decompress_program ();
+  exit (TAREXIT_SUCCESS);
+}
+
+/* Decompress the COUNT parts of the archive at FRAMES, up to
+   compress_workers_option parts at a time.  */
+static _Noreturn void
+decompress_frames_in_parallel (struct codec_frame const *frames,
+			       size_t count)
+{
+  compressed_frames = frames;
+  compressed_frame_count = count;
+  filter_frames_in_parallel (read_compressed_frame, FRAME_BUFFER_MAX,
+			     decompress_frame,
+			     _("decompression program"), _("(pipe)"), NULL);
+}
+
+/* Return the parts of the archive between the COUNT compressed OFFSETS
+   of the frames listed in the index.  The last part extends to the end
+   of the archive.  */
+static struct codec_frame *
+index_offsets_to_frames (off_t const *offsets, size_t count)
+{
+  struct codec_frame *frames = xnmalloc (count, sizeof *frames);
+  size_t i;
+
+  for (i = 0; i < count; i++)
+    {
+      frames[i].offset = offsets[i];
+      frames[i].check = -1;
+      if (i + 1 < count)
+	{
+	  frames[i].size = offsets[i + 1] - offsets[i];
+	  if (frames[i].size <= 0)
+	    FATAL_ERROR ((0, 0, _("%s: Index does not match the archive"),
+			  quotearg_colon (archive_name_array[0])));
+	}
+      else
+	frames[i].size = TYPE_MAXIMUM (off_t);
+    }
+  return frames;
+}
+
+/* Return true if the archive is a local regular file, which the
+   compression program can read by itself.  */
+bool
+sys_archive_file_is_regular (void)
+{
+  return (strcmp (archive_name_array[0], "-") != 0
+	  && !_remdev (archive_name_array[0])
+	  && is_regular_file (archive_name_array[0]));
+}
+
+/* Open the archive to be uncompressed, which is not a local regular
+   file, as ARCHIVE.  */
+static void
+open_archive_to_uncompress (void)
+{
+  if (strcmp (archive_name_array[0], "-") == 0)
+    archive = STDIN_FILENO;
+  else
+    archive = rmtopen (archive_name_array[0], O_RDONLY | O_BINARY,
+		       MODE_RW, rsh_command_option);
+  if (archive < 0)
+    open_fatal (archive_name_array[0]);
+}
+
+/* Set ARCHIVE for uncompressing, then reading an archive, starting at
+   OFFSET in the compressed archive.  OFFSET must be zero unless
+   sys_archive_file_is_regular returns true.  */
 pid_t
-sys_child_open_for_uncompress (void)
+sys_child_open_for_uncompress (off_t offset)
 {
   int parent_pipe[2];
   int child_pipe[2];
   pid_t grandchild_pid;
   pid_t child_pid;
+  off_t const *offsets;
+  struct codec_frame *frames;
+  size_t count;
+  int i;
 
   xpipe (parent_pipe);
+  if (read_queue_option)
+    set_pipe_size (parent_pipe[PREAD], read_queue_option * record_size);
   child_pid = xfork ();
 
   if (child_pid > 0)
@@ -527,19 +2010,19 @@ sys_child_open_for_uncompress (void)
   /* The newborn child tar is here!  */
 
   set_program_name (_("tar (child)"));
+  fatal_exit_hook = NULL;
   signal (SIGPIPE, SIG_DFL);
 
   xdup2 (parent_pipe[PWRITE], STDOUT_FILENO);
   xclose (parent_pipe[PREAD]);
+  decompress_codec = codec_for_program (first_decompress_program (&i));
 
   /* Check if we need a grandchild tar.  This happens only if either:
      a) we're reading stdin: to force unblocking;
      b) the file is to be accessed by rmt: compressor doesn't know how;
      c) the file is not a plain file.  */
 
-  if (strcmp (archive_name_array[0], "-") != 0
-      && !_remdev (archive_name_array[0])
-      && is_regular_file (archive_name_array[0]))
+  if (sys_archive_file_is_regular ())
     {
       /* We don't need a grandchild tar.  Open the archive and lauch the
 	 uncompressor.  */
@@ -547,11 +2030,47 @@ sys_child_open_for_uncompress (void)
       archive = open (archive_name_array[0], O_RDONLY | O_BINARY, MODE_RW);
       if (archive < 0)
 	open_fatal (archive_name_array[0]);
+      if (offset && lseek (archive, offset, SEEK_SET) != offset)
+	{
+	  seek_error_details (archive_name_array[0], offset);
+	  fatal_exit ();
+	}
       xdup2 (archive, STDIN_FILENO);
+      archive = STDIN_FILENO;
       priv_set_restore_linkdir ();
+
+      /* Decompress the frames listed in the index in parallel, or else
+	 the parts of the archive that its format allows to decompress
+	 independently.  */
+      count = index_frames_from (offset, &offsets);
+      if (count)
+	frames = index_offsets_to_frames (offsets, count);
+      else if (! offset && 1 < compress_workers_option && decompress_codec)
+	count = codec_find_frames (decompress_codec, archive, &frames);
+      if (1 < count)
+	decompress_frames_in_parallel (frames, count);
+
+      if (decompress_codec)
+	{
+	  decompress_with_library (decompressor_open (decompress_codec));
+	  exit (TAREXIT_SUCCESS);
+	}
       run_decompress_program ();
     }
 
+  if (offset)
+    abort ();
+
+  /* A library decompresses right here, reading the archive itself.  */
+
+  if (decompress_codec)
+    {
+      open_archive_to_uncompress ();
+      exit_status = TAREXIT_SUCCESS;
+      decompress_with_library (decompressor_open (decompress_codec));
+      exit (exit_status);
+    }
+
   /* We do need a grandchild tar.  */
 
   xpipe (child_pipe);
@@ -577,45 +2096,11 @@ sys_child_open_for_uncompress (void)
   xdup2 (child_pipe[PWRITE], STDOUT_FILENO);
   xclose (child_pipe[PREAD]);
 
-  if (strcmp (archive_name_array[0], "-") == 0)
-    archive = STDIN_FILENO;
-  else
-    archive = rmtopen (archive_name_array[0], O_RDONLY | O_BINARY,
-		       MODE_RW, rsh_command_option);
-  if (archive < 0)
-    open_fatal (archive_name_array[0]);
+  open_archive_to_uncompress ();
 
   /* Let's read the archive and pipe it into stdout.  */
 
-  while (1)
-    {
-      char *cursor;
-      size_t maximum;
-      size_t count;
-      size_t status;
-
-      clear_read_error_count ();
-
-    error_loop:
-      status = rmtread (archive, record_start->buffer, record_size);
-      if (status == SAFE_READ_ERROR)
-	{
-	  archive_read_error ();
-	  goto error_loop;
-	}
-      if (status == 0)
-	break;
-      cursor = record_start->buffer;
-      maximum = status;
-      while (maximum)
-	{
-	  count = maximum < BLOCKSIZE ? maximum : BLOCKSIZE;
-	  if (full_write (STDOUT_FILENO, cursor, count) != count)
-	    write_error (use_compress_program_option);
-	  cursor += count;
-	  maximum -= count;
-	}
-    }
+  copy_archive_to (STDOUT_FILENO, use_compress_program_option);
 
   xclose (STDOUT_FILENO);
 
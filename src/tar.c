@@ -68,6 +68,11 @@
 # define DEFAULT_BLOCKING 20
 #endif
 
+/* Files read ahead per read-ahead worker, unless --read-ahead is given.  */
+#ifndef READ_AHEAD_PER_WORKER
+# define READ_AHEAD_PER_WORKER 16
+#endif
+
 /* Print a message if not all links are dumped */
 static int check_links_option;
 
@@ -273,13 +278,20 @@ enum
   ACLS_OPTION = CHAR_MAX + 1,
   ATIME_PRESERVE_OPTION,
   BACKUP_OPTION,
+  CACHE_POLICY_OPTION,
   CHECK_DEVICE_OPTION,
   CHECKPOINT_OPTION,
   CHECKPOINT_ACTION_OPTION,
   CLAMP_MTIME_OPTION,
+  COMPRESS_WORKERS_OPTION,
+  CREATE_INDEX_OPTION,
   DELAY_DIRECTORY_RESTORE_OPTION,
+  EMBED_INDEX_OPTION,
   HARD_DEREFERENCE_OPTION,
   DELETE_OPTION,
+  EXTRACT_WORKERS_OPTION,
+  FAST_LIST_OPTION,
+  FRAME_SIZE_OPTION,
   FORCE_LOCAL_OPTION,
   FULL_TIME_OPTION,
   GROUP_OPTION,
@@ -319,8 +331,12 @@ enum
   OWNER_MAP_OPTION,
   PAX_OPTION,
   POSIX_OPTION,
+  PREALLOCATE_OPTION,
   QUOTE_CHARS_OPTION,
   QUOTING_STYLE_OPTION,
+  READ_AHEAD_OPTION,
+  READ_AHEAD_WORKERS_OPTION,
+  READ_QUEUE_OPTION,
   RECORD_SIZE_OPTION,
   RECURSIVE_UNLINK_OPTION,
   REMOVE_FILES_OPTION,
@@ -337,15 +353,18 @@ enum
   SORT_OPTION,
   HOLE_DETECTION_OPTION,
   SPARSE_VERSION_OPTION,
+  SPILL_LINK_NAMES_OPTION,
   STRIP_COMPONENTS_OPTION,
   SUFFIX_OPTION,
   TEST_LABEL_OPTION,
   TOTALS_OPTION,
   TO_COMMAND_OPTION,
   TRANSFORM_OPTION,
+  USE_INDEX_OPTION,
   UTC_OPTION,
   VOLNO_FILE_OPTION,
   WARNING_OPTION,
+  WRITE_QUEUE_OPTION,
   XATTR_OPTION,
   XATTR_EXCLUDE,
   XATTR_INCLUDE
@@ -443,6 +462,14 @@ static struct argp_option options[] = {
    N_("archive is seekable"), GRID+1 },
   {"no-seek", NO_SEEK_OPTION, NULL, 0,
    N_("archive is not seekable"), GRID+1 },
+  {"create-index", CREATE_INDEX_OPTION, N_("FILE"), 0,
+   N_("write an index of the archive members to FILE"), GRID+1 },
+  {"use-index", USE_INDEX_OPTION, N_("FILE"), 0,
+   N_("seek to the requested members using the index in FILE"), GRID+1 },
+  {"embed-index", EMBED_INDEX_OPTION, NULL, 0,
+   N_("store an index of the members at the end of the archive"), GRID+1 },
+  {"fast-list", FAST_LIST_OPTION, NULL, 0,
+   N_("list the archive using its embedded index"), GRID+1 },
   {"no-check-device", NO_CHECK_DEVICE_OPTION, NULL, 0,
    N_("do not check device numbers when creating incremental archives"),
    GRID+1 },
@@ -546,11 +573,14 @@ static struct argp_option options[] = {
       " directories until the end of extraction"), GRID+1 },
   {"no-delay-directory-restore", NO_DELAY_DIRECTORY_RESTORE_OPTION, 0, 0,
    N_("cancel the effect of --delay-directory-restore option"), GRID+1 },
+  {"preallocate", PREALLOCATE_OPTION, N_("WHAT"), OPTION_ARG_OPTIONAL,
+   N_("allocate disk space for extracted files before writing them;"
+      " WHAT is 'data' (default) or 'full'"), GRID+1 },
   {"sort", SORT_OPTION, N_("ORDER"), 0,
 #if D_INO_IN_DIRENT
-   N_("directory sorting order: none (default), name or inode"
+   N_("directory sorting order: none (default), name, inode or extent"
 #else
-   N_("directory sorting order: none (default) or name"
+   N_("directory sorting order: none (default), name or extent"
 #endif
      ), GRID+1 },
 #undef GRID
@@ -624,10 +654,28 @@ static struct argp_option options[] = {
    N_("BLOCKS x 512 bytes per record"), GRID+1 },
   {"record-size", RECORD_SIZE_OPTION, N_("NUMBER"), 0,
    N_("NUMBER of bytes per record, multiple of 512"), GRID+1 },
+  {"write-queue", WRITE_QUEUE_OPTION, N_("NUMBER"), 0,
+   N_("queue up to NUMBER records for writing to the archive by a"
+      " separate process"), GRID+1 },
   {"ignore-zeros", 'i', 0, 0,
    N_("ignore zeroed blocks in archive (means EOF)"), GRID+1 },
   {"read-full-records", 'B', 0, 0,
    N_("reblock as we read (for 4.2BSD pipes)"), GRID+1 },
+  {"read-ahead", READ_AHEAD_OPTION, N_("NUMBER"), 0,
+   N_("when creating, start reading NUMBER files ahead of the one being"
+      " archived"), GRID+1 },
+  {"read-ahead-workers", READ_AHEAD_WORKERS_OPTION, N_("NUMBER"), 0,
+   N_("look up and read ahead files in NUMBER separate processes"),
+   GRID+1 },
+  {"read-queue", READ_QUEUE_OPTION, N_("NUMBER"), 0,
+   N_("read up to NUMBER records of the archive ahead of their use"),
+   GRID+1 },
+  {"extract-workers", EXTRACT_WORKERS_OPTION, N_("NUMBER"), 0,
+   N_("write the data of extracted files in NUMBER parallel processes"),
+   GRID+1 },
+  {"cache-policy", CACHE_POLICY_OPTION, N_("POLICY"), 0,
+   N_("cache the data of archived and extracted files according to"
+      " POLICY: keep, drop or direct"), GRID+1 },
 #undef GRID
 
 #define GRID 80
@@ -671,6 +719,11 @@ static struct argp_option options[] = {
    GRID+1 },
   {"use-compress-program", 'I', N_("PROG"), 0,
    N_("filter through PROG (must accept -d)"), GRID+1 },
+  {"frame-size", FRAME_SIZE_OPTION, N_("SIZE"), 0,
+   N_("restart the compression program every SIZE bytes of archive"),
+   GRID+1 },
+  {"compress-workers", COMPRESS_WORKERS_OPTION, N_("NUMBER"), 0,
+   N_("compress or decompress NUMBER frames at a time"), GRID+1 },
   /* Note: docstrings for the options below are generated by tar_help_filter */
   {"bzip2", 'j', 0, 0, NULL, GRID+1 },
   {"gzip", 'z', 0, 0, NULL, GRID+1 },
@@ -695,6 +748,8 @@ static struct argp_option options[] = {
    N_("follow symlinks; archive and dump the files they point to"), GRID+1 },
   {"hard-dereference", HARD_DEREFERENCE_OPTION, 0, 0,
    N_("follow hard links; archive and dump the files they refer to"), GRID+1 },
+  {"spill-link-names", SPILL_LINK_NAMES_OPTION, 0, 0,
+   N_("keep the names of hard-linked files in a temporary file"), GRID+1 },
   {"starting-file", 'K', N_("MEMBER-NAME"), 0,
    N_("begin at member MEMBER-NAME when reading the archive"), GRID+1 },
   {"newer", 'N', N_("DATE-OR-FILE"), 0,
@@ -1278,12 +1333,16 @@ parse_owner_group (char *arg, uintmax_t field_max, char const **name_option)
 
 #define TAR_SIZE_SUFFIXES "bBcGgkKMmPTtw"
 
+/* Pseudo sort order for --sort=extent.  */
+#define SORT_EXTENT (-1)
+
 static char const *const sort_mode_arg[] = {
   "none",
   "name",
 #if D_INO_IN_DIRENT
   "inode",
 #endif
+  "extent",
   NULL
 };
 
@@ -1291,24 +1350,49 @@ static int sort_mode_flag[] = {
     SAVEDIR_SORT_NONE,
     SAVEDIR_SORT_NAME,
 #if D_INO_IN_DIRENT
-    SAVEDIR_SORT_INODE
+    SAVEDIR_SORT_INODE,
 #endif
+    SORT_EXTENT
 };
 
 ARGMATCH_VERIFY (sort_mode_arg, sort_mode_flag);
 
 static char const *const hole_detection_args[] =
 {
-  "raw", "seek", NULL
+  "raw", "seek", "fiemap", NULL
 };
 
 static int const hole_detection_types[] =
 {
-  HOLE_DETECTION_RAW, HOLE_DETECTION_SEEK
+  HOLE_DETECTION_RAW, HOLE_DETECTION_SEEK, HOLE_DETECTION_FIEMAP
 };
 
 ARGMATCH_VERIFY (hole_detection_args, hole_detection_types);
 
+static char const *const preallocate_args[] =
+{
+  "data", "full", NULL
+};
+
+static int const preallocate_types[] =
+{
+  PREALLOCATE_DATA, PREALLOCATE_FULL
+};
+
+ARGMATCH_VERIFY (preallocate_args, preallocate_types);
+
+static char const *const cache_policy_args[] =
+{
+  "keep", "drop", "direct", NULL
+};
+
+static int const cache_policy_types[] =
+{
+  CACHE_KEEP, CACHE_DROP, CACHE_DIRECT
+};
+
+ARGMATCH_VERIFY (cache_policy_args, cache_policy_types);
+
 
 static void
 set_old_files_option (int code, struct option_locus *loc)
@@ -1436,6 +1520,10 @@ parse_opt (int key, char *arg, struct argp_state *state)
       hard_dereference_option = true;
       break;
 
+    case SPILL_LINK_NAMES_OPTION:
+      spill_link_names_option = true;
+      break;
+
     case 'i':
       /* Ignore zero blocks (eofs).  This can't be the default,
 	 because Unix tar writes two blocks of zeros, then pads out
@@ -1541,6 +1629,45 @@ parse_opt (int key, char *arg, struct argp_state *state)
       seek_option = 0;
       break;
 
+    case CREATE_INDEX_OPTION:
+      create_index_option = arg;
+      break;
+
+    case USE_INDEX_OPTION:
+      use_index_option = arg;
+      break;
+
+    case EMBED_INDEX_OPTION:
+      embed_index_option = true;
+      break;
+
+    case FAST_LIST_OPTION:
+      fast_list_option = true;
+      break;
+
+    case COMPRESS_WORKERS_OPTION:
+      {
+	uintmax_t u;
+	if (! (xstrtoumax (arg, NULL, 10, &u, "") == LONGINT_OK
+	       && u == (size_t) u))
+	  USAGE_ERROR ((0, 0, "%s: %s", quotearg_colon (arg),
+			_("Invalid number of compression workers")));
+	compress_workers_option = u;
+      }
+      break;
+
+    case FRAME_SIZE_OPTION:
+      {
+	uintmax_t u;
+
+	if (! (xstrtoumax (arg, NULL, 10, &u, TAR_SIZE_SUFFIXES) == LONGINT_OK
+	       && 0 < u && u <= TYPE_MAXIMUM (off_t) / 2))
+	  USAGE_ERROR ((0, 0, "%s: %s", quotearg_colon (arg),
+			_("Invalid frame size")));
+	frame_size_option = u;
+      }
+      break;
+
     case 'N':
       after_date_option = true;
       /* Fall through.  */
@@ -1722,6 +1849,11 @@ parse_opt (int key, char *arg, struct argp_state *state)
 	args->version_control_string = arg;
       break;
 
+    case CACHE_POLICY_OPTION:
+      cache_policy_option = XARGMATCH ("--cache-policy", arg,
+				       cache_policy_args, cache_policy_types);
+      break;
+
     case DELAY_DIRECTORY_RESTORE_OPTION:
       delay_directory_restore_option = true;
       break;
@@ -1734,10 +1866,28 @@ parse_opt (int key, char *arg, struct argp_state *state)
       set_subcommand_option (DELETE_SUBCOMMAND);
       break;
 
+    case EXTRACT_WORKERS_OPTION:
+      {
+	uintmax_t u;
+	if (! (xstrtoumax (arg, NULL, 10, &u, "") == LONGINT_OK
+	       && u == (size_t) u))
+	  USAGE_ERROR ((0, 0, "%s: %s", quotearg_colon (arg),
+			_("Invalid number of extraction workers")));
+	extract_workers_option = u;
+      }
+      break;
+
     case FORCE_LOCAL_OPTION:
       force_local_option = true;
       break;
 
+    case PREALLOCATE_OPTION:
+      preallocate_option = (arg
+			    ? XARGMATCH ("--preallocate", arg,
+					 preallocate_args, preallocate_types)
+			    : PREALLOCATE_DATA);
+      break;
+
     case 'H':
       set_archive_format (arg);
       break;
@@ -1874,6 +2024,39 @@ parse_opt (int key, char *arg, struct argp_state *state)
       set_archive_format ("posix");
       break;
 
+    case READ_AHEAD_OPTION:
+      {
+	uintmax_t u;
+	if (! (xstrtoumax (arg, NULL, 10, &u, "") == LONGINT_OK
+	       && u == (size_t) u))
+	  USAGE_ERROR ((0, 0, "%s: %s", quotearg_colon (arg),
+			_("Invalid number of files to read ahead")));
+	read_ahead_option = u;
+      }
+      break;
+
+    case READ_AHEAD_WORKERS_OPTION:
+      {
+	uintmax_t u;
+	if (! (xstrtoumax (arg, NULL, 10, &u, "") == LONGINT_OK
+	       && u == (size_t) u))
+	  USAGE_ERROR ((0, 0, "%s: %s", quotearg_colon (arg),
+			_("Invalid number of read-ahead workers")));
+	read_ahead_workers_option = u;
+      }
+      break;
+
+    case READ_QUEUE_OPTION:
+      {
+	uintmax_t u;
+	if (! (xstrtoumax (arg, NULL, 10, &u, "") == LONGINT_OK
+	       && u == (size_t) u))
+	  USAGE_ERROR ((0, 0, "%s: %s", quotearg_colon (arg),
+			_("Invalid number of records")));
+	read_queue_option = u;
+      }
+      break;
+
     case RECORD_SIZE_OPTION:
       {
 	uintmax_t u;
@@ -1946,6 +2129,9 @@ parse_opt (int key, char *arg, struct argp_state *state)
     case SORT_OPTION:
       savedir_sort_order = XARGMATCH ("--sort", arg,
 				      sort_mode_arg, sort_mode_flag);
+      sort_extent_option = savedir_sort_order == SORT_EXTENT;
+      if (sort_extent_option)
+	savedir_sort_order = SAVEDIR_SORT_FASTREAD;
       break;
 
     case SUFFIX_OPTION:
@@ -2026,6 +2212,17 @@ parse_opt (int key, char *arg, struct argp_state *state)
       set_warning_option (arg);
       break;
 
+    case WRITE_QUEUE_OPTION:
+      {
+	uintmax_t u;
+	if (! (xstrtoumax (arg, NULL, 10, &u, "") == LONGINT_OK
+	       && u == (size_t) u))
+	  USAGE_ERROR ((0, 0, "%s: %s", quotearg_colon (arg),
+			_("Invalid number of records")));
+	write_queue_option = u;
+      }
+      break;
+
     case '0':
     case '1':
     case '2':
@@ -2472,6 +2669,46 @@ decode_options (int argc, char **argv)
 	}
     }
 
+  if (create_index_option)
+    {
+      if (subcommand_option != CREATE_SUBCOMMAND)
+	option_conflict_error ("--create-index",
+			       subcommand_string (subcommand_option));
+      if (multi_volume_option)
+	USAGE_ERROR ((0, 0, _("Cannot index multi-volume archives")));
+    }
+
+  if (use_index_option)
+    {
+      if (subcommand_option != EXTRACT_SUBCOMMAND
+	  && subcommand_option != LIST_SUBCOMMAND
+	  && subcommand_option != DIFF_SUBCOMMAND)
+	option_conflict_error ("--use-index",
+			       subcommand_string (subcommand_option));
+      if (multi_volume_option)
+	USAGE_ERROR ((0, 0, _("Cannot use an index with multi-volume archives")));
+    }
+
+  if (embed_index_option)
+    {
+      if (subcommand_option != CREATE_SUBCOMMAND)
+	option_conflict_error ("--embed-index",
+			       subcommand_string (subcommand_option));
+      if (multi_volume_option)
+	USAGE_ERROR ((0, 0, _("Cannot index multi-volume archives")));
+    }
+
+  if (fast_list_option)
+    {
+      if (subcommand_option != LIST_SUBCOMMAND)
+	option_conflict_error ("--fast-list",
+			       subcommand_string (subcommand_option));
+      if (use_index_option)
+	option_conflict_error ("--fast-list", "--use-index");
+      if (multi_volume_option)
+	USAGE_ERROR ((0, 0, _("Cannot use an index with multi-volume archives")));
+    }
+
   if (use_compress_program_option)
     {
       if (multi_volume_option)
@@ -2482,6 +2719,42 @@ decode_options (int argc, char **argv)
 	USAGE_ERROR ((0, 0, _("Cannot concatenate compressed archives")));
     }
 
+  if (read_ahead_workers_option && ! read_ahead_option)
+    read_ahead_option = read_ahead_workers_option * READ_AHEAD_PER_WORKER;
+
+  if (compress_workers_option)
+    {
+      switch (subcommand_option)
+	{
+	case CREATE_SUBCOMMAND:
+	  /* Workers compress separate frames.  */
+	  if (1 < compress_workers_option && ! frame_size_option)
+	    USAGE_ERROR ((0, 0, _("--compress-workers needs --frame-size")));
+	  break;
+
+	case LIST_SUBCOMMAND:
+	case EXTRACT_SUBCOMMAND:
+	case DIFF_SUBCOMMAND:
+	  /* Frames are found through the index, or else in zstd and xz
+	     archives themselves.  */
+	  break;
+
+	default:
+	  option_conflict_error ("--compress-workers",
+				 subcommand_string (subcommand_option));
+	}
+    }
+
+  if (frame_size_option)
+    {
+      if (subcommand_option != CREATE_SUBCOMMAND)
+	option_conflict_error ("--frame-size",
+			       subcommand_string (subcommand_option));
+      /* Frames consist of whole records.  */
+      frame_size_option += record_size - 1;
+      frame_size_option -= frame_size_option % record_size;
+    }
+
   if (set_mtime_option == CLAMP_MTIME)
     {
       if (!TIME_OPTION_INITIALIZED (mtime_option))
@@ -2624,6 +2897,12 @@ decode_options (int argc, char **argv)
 	  && strcmp (archive_name_array[0], "-"))
 	set_compression_program_by_suffix (archive_name_array[0],
 					   use_compress_program_option);
+      if (frame_size_option && use_compress_program_option
+	  && ! compress_program_allows_frames (use_compress_program_option))
+	USAGE_ERROR ((0, 0,
+		      _("--frame-size cannot be used with %s: it is not"
+			" known to decompress concatenated streams"),
+		      quote (use_compress_program_option)));
       break;
 
     case EXTRACT_SUBCOMMAND:
@@ -2845,6 +3124,7 @@ tar_stat_destroy (struct tar_stat_info *st)
   free (st->acls_d_ptr);
   free (st->sparse_map);
   free (st->dumpdir);
+  free (st->dirrest);
   xheader_destroy (&st->xhdr);
   info_free_exclist (st);
   memset (st, 0, sizeof (*st));
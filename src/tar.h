@@ -351,6 +351,14 @@ struct tar_stat_info
      and should be closed instead of FD.  */
   DIR *dirstream;
 
+  /* True if the directory is archived while DIRSTREAM is being read,
+     rather than from a list of its entries read in advance.  */
+  bool dirstreamed;
+
+  /* If DIRSTREAMED and the stream had to be closed, the entries that
+     were left to be read, in the format used by savedir.  */
+  char *dirrest;
+
   /* File descriptor, if creating an archive, and if a directory or a
      regular file or a contiguous file.
 
@@ -365,6 +373,13 @@ struct tar_stat_info
 
   /* Exclusion list */
   struct exclist *exclude_list;
+
+  /* True if the exclusion lists of this directory were looked for.  */
+  bool exclude_list_attached;
+
+  /* If so, the nearest ancestor whose exclusion lists apply to its
+     subdirectories, or NULL if there is none.  */
+  struct tar_stat_info *exclude_parent;
 };
 
 union block
@@ -0,0 +1,838 @@
+/* Member index files for GNU tar.
+
+   Copyright 2016 Free Software Foundation, Inc.
+
+   This file is part of GNU tar.
+
+   GNU tar is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU tar is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <system.h>
+#include <quotearg.h>
+#include "common.h"
+#include <rmt.h>
+
+/* Version of the index file format.  */
+#define TAR_INDEX_VERSION 1
+
+/* An index file starts with the line
+
+     GNU tar-VERSION-TAR_INDEX_VERSION
+
+   followed by an entry for each archive member, in archive order.
+   Each entry consists of the following null-terminated fields:
+
+     1. Offset of the first header of the member (including any long
+        name or extended headers) in the archive, in bytes.
+     2. Offset of the member data.
+     3. Member size.
+     4. Type flag, as a single character.
+     5. Number of entries in the sparse map, followed by the offset
+        and size of each of them.
+     6. Member name, as stored in the archive, without trailing
+        slashes.
+
+   Volume labels and global extended headers are recorded in the same
+   way, with their type flag, a null size and their name, so that they
+   can be read before the members that follow them.
+
+   Offsets are counted in the uncompressed archive.
+
+   If the archive was compressed in frames (see --frame-size), the
+   entries are followed by the frame table: the field "F", the frame
+   size, the number of frames and the offset of each frame in the
+   compressed archive.
+
+   With --embed-index, the index is also stored in the archive itself,
+   as the data of a regular member named INDEX_MEMBER_NAME that
+   follows the last archived member.  The index is padded with nulls
+   to a block boundary and followed by a trailer block, which starts
+   with INDEX_TRAILER_MAGIC followed by the offset of the index member
+   header and the size of the index, each terminated by a newline.
+   The trailer is thus the last non-null block before the end of the
+   archive, which lets --fast-list locate the index without reading
+   the rest of the archive.  */
+
+#define INDEX_MEMBER_NAME "GNU.index"
+#define INDEX_TRAILER_MAGIC "GNU tar index trailer\n"
+
+struct index_entry
+{
+  off_t header_offset;          /* Offset of the first header */
+  off_t data_offset;            /* Offset of the data */
+  off_t size;                   /* Member size */
+  char typeflag;                /* Type flag */
+  size_t sparse_map_size;       /* Number of sparse map entries */
+  struct sp_array *sparse_map;  /* Sparse map */
+  char *name;                   /* Member name */
+};
+
+/* Index file being written.  */
+static FILE *index_stream;
+
+/* Temporary file to which the compressor writes the offsets of the
+   frames, while the index is being written.  */
+static FILE *frame_stream;
+
+/* Name of the index being read, for diagnostics.  */
+static char const *index_name;
+
+/* Index that was read, with INDEX_COUNT entries.  */
+static struct index_entry *index_table;
+static size_t index_count;
+
+/* True if the index records volume labels or global extended
+   headers.  */
+static bool index_has_headers;
+
+/* True if the index is used to seek in the archive.  */
+static bool index_active;
+
+/* Next entry to consider in the index.  */
+static size_t index_next;
+
+/* Frame size and the compressed offsets of the INDEX_FRAME_COUNT frames
+   of a compressed archive, from the index that was read.  */
+static off_t index_frame_size;
+static off_t *index_frames;
+static size_t index_frame_count;
+
+/* True if the index is used to seek by restarting decompression.  */
+static bool index_frames_active;
+
+/* Entry expected at the next header read, if any.  */
+static struct index_entry const *index_pending;
+
+/* Return true if E records a volume label or a global extended header
+   rather than a member.  These are read whenever the archive is, as
+   they apply to the members that follow them.  */
+static bool
+index_header_entry (struct index_entry const *e)
+{
+  return e->typeflag == GNUTYPE_VOLHDR || e->typeflag == XGLTYPE;
+}
+
+
+/* Creating the index.  */
+
+void
+index_create_start (void)
+{
+  if (create_index_option)
+    {
+      index_stream = fopen (create_index_option,
+			    embed_index_option ? "w+" : "w");
+      if (! index_stream)
+	open_fatal (create_index_option);
+    }
+  else
+    {
+      index_stream = tmpfile ();
+      if (! index_stream)
+	FATAL_ERROR ((0, errno, _("Cannot create temporary file")));
+    }
+  fprintf (index_stream, "%s-%s-%d\n", PACKAGE_NAME, PACKAGE_VERSION,
+	   TAR_INDEX_VERSION);
+  /* Do not leave the line buffered for the processes forked when the
+     archive is opened.  */
+  fflush (index_stream);
+}
+
+static void
+index_write_num (uintmax_t n)
+{
+  char buf[UINTMAX_STRSIZE_BOUND];
+  char const *s = umaxtostr (n, buf);
+  fwrite (s, strlen (s) + 1, 1, index_stream);
+}
+
+/* Record the member described by ST, whose type is TYPEFLAG and whose
+   first header is at BLOCK_ORDINAL.  Its data start at the current
+   block.  */
+void
+index_add_member (struct tar_stat_info const *st, char typeflag,
+		  off_t block_ordinal)
+{
+  size_t len;
+  size_t i;
+
+  if (! index_stream || block_ordinal < 0)
+    return;
+
+  index_write_num (block_ordinal * BLOCKSIZE);
+  index_write_num (current_block_ordinal () * BLOCKSIZE);
+  index_write_num (st->stat.st_size);
+  /* Old archives use a null type flag for regular files.  */
+  if (! typeflag)
+    typeflag = REGTYPE;
+  fwrite (&typeflag, 1, 1, index_stream);
+  fwrite ("", 1, 1, index_stream);
+
+  if (st->is_sparse)
+    {
+      index_write_num (st->sparse_map_avail);
+      for (i = 0; i < st->sparse_map_avail; i++)
+	{
+	  index_write_num (st->sparse_map[i].offset);
+	  index_write_num (st->sparse_map[i].numbytes);
+	}
+    }
+  else
+    index_write_num (0);
+
+  for (len = strlen (st->file_name); 1 < len; len--)
+    if (! ISSLASH (st->file_name[len - 1]))
+      break;
+  fwrite (st->file_name, len, 1, index_stream);
+  fwrite ("", 1, 1, index_stream);
+}
+
+/* Write an entry without a sparse map.  */
+static void
+index_write_entry (off_t header_offset, off_t data_offset, off_t size,
+		   char typeflag, char const *name)
+{
+  index_write_num (header_offset);
+  index_write_num (data_offset);
+  index_write_num (size);
+  fwrite (&typeflag, 1, 1, index_stream);
+  fwrite ("", 1, 1, index_stream);
+  index_write_num (0);
+  fwrite (name, strlen (name) + 1, 1, index_stream);
+}
+
+/* Record the volume label or global extended header of type TYPEFLAG
+   named NAME, whose header is at BLOCK_ORDINAL.  */
+void
+index_add_header (char typeflag, char const *name, off_t block_ordinal)
+{
+  if (index_stream)
+    index_write_entry (block_ordinal * BLOCKSIZE,
+		       current_block_ordinal () * BLOCKSIZE, 0,
+		       typeflag, name);
+}
+
+/* Return the descriptor to which the compressor should write the frame
+   offsets, or -1 if they are not needed.  */
+int
+index_frames_fd (void)
+{
+  if (! (create_index_option && frame_size_option))
+    return -1;
+  frame_stream = tmpfile ();
+  if (! frame_stream)
+    FATAL_ERROR ((0, errno, _("Cannot create temporary file")));
+  return fileno (frame_stream);
+}
+
+/* Append the frame table to the index, if the offsets of all the frames
+   are known.  */
+static void
+index_write_frames (void)
+{
+  off_t frames = ((records_written * record_size + frame_size_option - 1)
+		  / frame_size_option);
+  off_t count = 0;
+  uintmax_t u;
+
+  rewind (frame_stream);
+  while (fscanf (frame_stream, "%ju", &u) == 1)
+    count++;
+  if (count != frames)
+    {
+      WARN ((0, 0, _("%s: Frame offsets are unknown, not indexed"),
+	     quotearg_colon (create_index_option)));
+      return;
+    }
+
+  fwrite ("F", 2, 1, index_stream);
+  index_write_num (frame_size_option);
+  index_write_num (count);
+  rewind (frame_stream);
+  while (fscanf (frame_stream, "%ju", &u) == 1)
+    index_write_num (u);
+}
+
+static _Noreturn void
+index_temp_error (void)
+{
+  FATAL_ERROR ((0, errno, _("Cannot write the archive index")));
+}
+
+/* Append the index to the archive, as the data of the member
+   INDEX_MEMBER_NAME, followed by the trailer block.  Must be called
+   after the last member has been archived.  */
+void
+index_embed (void)
+{
+  FILE *fp = index_stream;
+  off_t block_ordinal = current_block_ordinal ();
+  off_t size;
+  off_t blocks;
+  off_t member_size;
+  union block *blk;
+  char buf[UINTMAX_STRSIZE_BOUND];
+
+  if (! fp)
+    return;
+  /* The index member is not indexed.  */
+  index_stream = NULL;
+
+  if (fflush (fp) != 0 || (size = ftello (fp)) < 0
+      || fseeko (fp, 0, SEEK_SET) != 0)
+    index_temp_error ();
+  blocks = (size + BLOCKSIZE - 1) / BLOCKSIZE;
+  member_size = (blocks + 1) * BLOCKSIZE;
+
+  blk = start_private_header (INDEX_MEMBER_NAME, member_size,
+			      start_time.tv_sec);
+  blk->header.typeflag = REGTYPE;
+  simple_finish_header (blk);
+
+  for (; blocks; blocks--)
+    {
+      blk = find_next_block ();
+      memset (blk->buffer, 0, BLOCKSIZE);
+      if (fread (blk->buffer, 1, BLOCKSIZE, fp) == 0 && ferror (fp))
+	index_temp_error ();
+      set_next_block_after (blk);
+    }
+
+  blk = find_next_block ();
+  memset (blk->buffer, 0, BLOCKSIZE);
+  strcpy (blk->buffer, INDEX_TRAILER_MAGIC);
+  strcat (blk->buffer, umaxtostr (block_ordinal * BLOCKSIZE, buf));
+  strcat (blk->buffer, "\n");
+  strcat (blk->buffer, umaxtostr (size, buf));
+  strcat (blk->buffer, "\n");
+  set_next_block_after (blk);
+
+  /* The index file given by --create-index lists the index member,
+     which the embedded copy cannot do.  */
+  if (fseeko (fp, 0, SEEK_END) != 0)
+    index_temp_error ();
+  index_stream = fp;
+  index_write_entry (block_ordinal * BLOCKSIZE,
+		     (block_ordinal + 1) * BLOCKSIZE,
+		     member_size, REGTYPE, INDEX_MEMBER_NAME);
+}
+
+void
+index_create_finish (void)
+{
+  if (frame_stream)
+    {
+      if (index_stream)
+	index_write_frames ();
+      fclose (frame_stream);
+      frame_stream = NULL;
+    }
+  if (! index_stream)
+    return;
+  if (! create_index_option)
+    {
+      fclose (index_stream);
+      index_stream = NULL;
+      return;
+    }
+  if (ferror (index_stream))
+    write_error (create_index_option);
+  if (fclose (index_stream) != 0)
+    close_error (create_index_option);
+  index_stream = NULL;
+}
+
+
+/* Reading the index.  */
+
+static _Noreturn void
+index_format_error (FILE *fp)
+{
+  char offbuf[INT_BUFSIZE_BOUND (off_t)];
+  FATAL_ERROR ((0, 0, _("%s: byte %s: %s"),
+		quotearg_colon (index_name),
+		offtostr (ftello (fp), offbuf),
+		_("Malformed index file")));
+}
+
+/* Read from FP a null-terminated string into the obstack STK.  Return
+   false at end of file.  */
+static bool
+index_read_string (FILE *fp, struct obstack *stk)
+{
+  int c;
+
+  while ((c = getc (fp)) != EOF && c != 0)
+    obstack_1grow (stk, c);
+  if (c == EOF)
+    {
+      if (ferror (fp))
+	read_fatal (index_name);
+      if (obstack_object_size (stk))
+	index_format_error (fp);
+      return false;
+    }
+  obstack_1grow (stk, 0);
+  return true;
+}
+
+/* Convert the field S read from FP to a number not exceeding MAX_VAL.  */
+static uintmax_t
+index_parse_num (FILE *fp, char const *s, uintmax_t max_val)
+{
+  char *end;
+  uintmax_t u;
+
+  errno = 0;
+  u = strtoumax (s, &end, 10);
+  if (! (ISDIGIT (*s) && !*end && errno == 0 && u <= max_val))
+    index_format_error (fp);
+  return u;
+}
+
+/* Read from FP a null-terminated number not exceeding MAX_VAL.
+   Return false at end of file.  */
+static bool
+index_read_num (FILE *fp, struct obstack *stk, uintmax_t max_val,
+		uintmax_t *pval)
+{
+  char *s;
+
+  if (! index_read_string (fp, stk))
+    return false;
+  s = obstack_finish (stk);
+  *pval = index_parse_num (fp, s, max_val);
+  obstack_free (stk, s);
+  return true;
+}
+
+static off_t
+index_read_off (FILE *fp, struct obstack *stk)
+{
+  uintmax_t u;
+  if (! index_read_num (fp, stk, TYPE_MAXIMUM (off_t), &u))
+    index_format_error (fp);
+  return u;
+}
+
+/* Read the frame table from FP.  It must be the last part of the
+   index.  */
+static void
+index_read_frames (FILE *fp, struct obstack *stk)
+{
+  uintmax_t u;
+  size_t i;
+
+  index_frame_size = index_read_off (fp, stk);
+  if (! index_read_num (fp, stk, SIZE_MAX / sizeof *index_frames, &u)
+      || index_frame_size == 0)
+    index_format_error (fp);
+  index_frame_count = u;
+  index_frames = xnmalloc (index_frame_count, sizeof *index_frames);
+  for (i = 0; i < index_frame_count; i++)
+    index_frames[i] = index_read_off (fp, stk);
+  if (index_read_string (fp, stk))
+    index_format_error (fp);
+}
+
+/* Number of entries allocated in INDEX_TABLE.  */
+static size_t index_allocated;
+
+/* Append E to INDEX_TABLE.  */
+static void
+index_append (struct index_entry const *e)
+{
+  if (index_header_entry (e))
+    index_has_headers = true;
+  if (index_count == index_allocated)
+    index_table = x2nrealloc (index_table, &index_allocated,
+			      sizeof *index_table);
+  index_table[index_count++] = *e;
+}
+
+/* Read the index from FP into INDEX_TABLE.  */
+static void
+index_read (FILE *fp)
+{
+  char *buf = NULL;
+  size_t bufsize = 0;
+  struct obstack stk;
+  char *ebuf;
+  uintmax_t u;
+
+  if (getline (&buf, &bufsize, fp) <= 0
+      || strncmp (buf, PACKAGE_NAME "-", sizeof PACKAGE_NAME) != 0
+      || ! (ebuf = strrchr (buf, '-'))
+      || (errno = 0, u = strtoumax (ebuf + 1, &ebuf, 10),
+	  errno != 0 || *ebuf != '\n')
+      || u != TAR_INDEX_VERSION)
+    FATAL_ERROR ((0, 0, _("%s: Unsupported index format"),
+		  quotearg_colon (index_name)));
+  free (buf);
+
+  obstack_init (&stk);
+  for (;;)
+    {
+      struct index_entry e;
+      size_t i;
+      char *s;
+
+      if (! index_read_string (fp, &stk))
+	break;
+      s = obstack_finish (&stk);
+      if (strcmp (s, "F") == 0)
+	{
+	  obstack_free (&stk, s);
+	  index_read_frames (fp, &stk);
+	  break;
+	}
+      e.header_offset = index_parse_num (fp, s, TYPE_MAXIMUM (off_t));
+      obstack_free (&stk, s);
+      e.data_offset = index_read_off (fp, &stk);
+      e.size = index_read_off (fp, &stk);
+
+      if (! index_read_string (fp, &stk))
+	index_format_error (fp);
+      s = obstack_finish (&stk);
+      if (strlen (s) != 1)
+	index_format_error (fp);
+      e.typeflag = *s;
+      obstack_free (&stk, s);
+
+      if (! index_read_num (fp, &stk, SIZE_MAX / sizeof *e.sparse_map, &u))
+	index_format_error (fp);
+      e.sparse_map_size = u;
+      e.sparse_map = (u
+		      ? xnmalloc (e.sparse_map_size, sizeof *e.sparse_map)
+		      : NULL);
+      for (i = 0; i < e.sparse_map_size; i++)
+	{
+	  e.sparse_map[i].offset = index_read_off (fp, &stk);
+	  e.sparse_map[i].numbytes = index_read_off (fp, &stk);
+	}
+
+      if (! index_read_string (fp, &stk))
+	index_format_error (fp);
+      s = obstack_finish (&stk);
+      e.name = xstrdup (s);
+      obstack_free (&stk, s);
+
+      index_append (&e);
+    }
+  obstack_free (&stk, NULL);
+}
+
+/* Read SIZE bytes at OFFSET in the archive into BUF.  */
+static bool
+index_read_archive (off_t offset, char *buf, size_t size)
+{
+  if (rmtlseek (archive, offset, SEEK_SET) != offset)
+    return false;
+  while (size)
+    {
+      size_t n = rmtread (archive, buf, size);
+      if (n == 0 || n == SAFE_READ_ERROR)
+	return false;
+      buf += n;
+      size -= n;
+    }
+  return true;
+}
+
+/* Number of blocks read at a time while looking for the trailer.  */
+#define INDEX_SCAN_BLOCKS 64
+
+/* Look for an index embedded at the end of the archive.  If there is
+   one, return a stream holding it and describe the member holding it
+   in *MEMBER, otherwise return NULL.  The archive must be seekable;
+   its position is preserved.  */
+static FILE *
+index_find_embedded (struct index_entry *member)
+{
+  off_t pos = rmtlseek (archive, 0, SEEK_CUR);
+  off_t end = rmtlseek (archive, 0, SEEK_END);
+  union block *blocks = xnmalloc (INDEX_SCAN_BLOCKS, BLOCKSIZE);
+  union block *trailer = NULL;
+  FILE *fp = NULL;
+  char *data = NULL;
+  uintmax_t header_offset;
+  uintmax_t size;
+  char *p;
+
+  if (pos < 0 || end < 0)
+    {
+      free (blocks);
+      return NULL;
+    }
+  end -= end % BLOCKSIZE;
+
+  /* The trailer is the last block that is not all zeros.  */
+  while (! trailer && 0 < end)
+    {
+      size_t n = min (end / BLOCKSIZE, INDEX_SCAN_BLOCKS);
+      end -= n * BLOCKSIZE;
+      if (! index_read_archive (end, blocks->buffer, n * BLOCKSIZE))
+	break;
+      while (n--)
+	{
+	  char const *b = blocks[n].buffer;
+	  if (b[0] || memcmp (b, b + 1, BLOCKSIZE - 1))
+	    {
+	      trailer = &blocks[n];
+	      end += n * BLOCKSIZE;
+	      break;
+	    }
+	}
+    }
+
+  if (trailer
+      && strncmp (trailer->buffer, INDEX_TRAILER_MAGIC,
+		  sizeof INDEX_TRAILER_MAGIC - 1) == 0
+      && (errno = 0,
+	  header_offset = strtoumax (trailer->buffer
+				     + sizeof INDEX_TRAILER_MAGIC - 1,
+				     &p, 10),
+	  *p++ == '\n')
+      && (size = strtoumax (p, &p, 10), *p == '\n' && errno == 0)
+      && header_offset % BLOCKSIZE == 0
+      && size <= end
+      && header_offset + BLOCKSIZE + (size + BLOCKSIZE - 1)
+	  / BLOCKSIZE * BLOCKSIZE == end
+      && index_read_archive (header_offset, blocks->buffer, BLOCKSIZE)
+      && tar_checksum (blocks, true) == HEADER_SUCCESS
+      && strcmp (blocks->header.name, INDEX_MEMBER_NAME) == 0)
+    {
+      data = xmalloc (size);
+      if (! index_read_archive (header_offset + BLOCKSIZE, data, size))
+	read_fatal (index_name);
+      fp = tmpfile ();
+      if (! fp)
+	FATAL_ERROR ((0, errno, _("Cannot create temporary file")));
+      if (fwrite (data, 1, size, fp) != size || fflush (fp) != 0
+	  || fseeko (fp, 0, SEEK_SET) != 0)
+	index_temp_error ();
+      free (data);
+
+      member->header_offset = header_offset;
+      member->data_offset = header_offset + BLOCKSIZE;
+      member->size = end - member->data_offset;
+      member->typeflag = REGTYPE;
+      member->sparse_map_size = 0;
+      member->sparse_map = NULL;
+      member->name = xstrdup (INDEX_MEMBER_NAME);
+    }
+
+  free (blocks);
+  if (rmtlseek (archive, pos, SEEK_SET) != pos)
+    {
+      seek_error (index_name);
+      fatal_exit ();
+    }
+  return fp;
+}
+
+/* Read the index named by --use-index, or with --fast-list the index
+   embedded in the archive, and start using it if the archive is
+   seekable.  Must be called after the archive is open.  */
+void
+index_load (void)
+{
+  FILE *fp;
+  struct index_entry member;
+
+  index_active = false;
+  index_frames_active = false;
+  index_next = 0;
+  index_pending = NULL;
+
+  if (use_index_option)
+    {
+      index_name = use_index_option;
+      fp = fopen (use_index_option, "r");
+      if (! fp)
+	open_fatal (use_index_option);
+    }
+  else
+    {
+      index_name = *archive_name_cursor;
+      if (! seekable_archive)
+	{
+	  WARN ((0, 0, _("%s: Archive is not seekable, index not used"),
+		 quotearg_colon (index_name)));
+	  return;
+	}
+      fp = index_find_embedded (&member);
+      if (! fp)
+	{
+	  WARN ((0, 0, _("%s: Archive has no embedded index"),
+		 quotearg_colon (index_name)));
+	  return;
+	}
+    }
+
+  index_read (fp);
+  if (fclose (fp) != 0)
+    close_error (index_name);
+  /* The embedded index does not list the member that holds it.  */
+  if (! use_index_option)
+    index_append (&member);
+
+  /* A compressed archive can be seeked by restarting decompression at
+     the start of a frame.  */
+  index_frames_active = (! seekable_archive && index_frame_count
+			 && compressed_archive_seekable ());
+
+  /* Names are matched one by one with --preserve-order, so it is not
+     known in advance which members are wanted.  */
+  index_active = ((seekable_archive || index_frames_active)
+		  && ! same_order_option);
+  if (! (seekable_archive || index_frames_active))
+    WARN ((0, 0, _("%s: Archive is not seekable, index not used"),
+	   quotearg_colon (index_name)));
+
+  /* Decompress the frames in parallel from the start.  Nothing has been
+     read from the archive yet.  */
+  if (index_frames_active && 1 < compress_workers_option
+      && 1 < index_frame_count)
+    restart_decompression (index_frames[0], 0);
+}
+
+/* If the frames of the archive are to be decompressed in parallel,
+   return the number of frames from the one at compressed OFFSET to
+   the end of the archive, and set *OFFSETS to their offsets.
+   Otherwise, return 0.  */
+size_t
+index_frames_from (off_t offset, off_t const **offsets)
+{
+  size_t lo = 0;
+  size_t hi = index_frame_count;
+
+  if (! (index_frames_active && 1 < compress_workers_option))
+    return 0;
+
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (index_frames[mid] < offset)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  if (lo == index_frame_count || index_frames[lo] != offset)
+    return 0;
+  *offsets = index_frames + lo;
+  return index_frame_count - lo;
+}
+
+/* Restart decompression at the frame containing OFFSET in the
+   uncompressed archive, unless that frame is already being read.  */
+static void
+index_seek_frame (off_t offset)
+{
+  size_t frame = offset / index_frame_size;
+  off_t start = frame * index_frame_size;
+
+  if (index_frame_count <= frame)
+    FATAL_ERROR ((0, 0, _("%s: Index does not match the archive"),
+		  quotearg_colon (index_name)));
+  if (current_block_ordinal () * BLOCKSIZE < start)
+    restart_decompression (index_frames[frame], start / BLOCKSIZE);
+}
+
+/* List the members named in the index without reading the archive,
+   if possible, i.e. if nothing but their names is to be printed and
+   there are no volume labels or global headers to read.  */
+void
+index_list_members (void)
+{
+  if (! index_active || index_has_headers || verbose_option || block_number_option
+      || incremental_option || occurrence_option
+      || show_transformed_names_option
+      || TIME_OPTION_INITIALIZED (newer_mtime_option))
+    return;
+
+  for (; index_next < index_count; index_next++)
+    {
+      struct index_entry const *e = &index_table[index_next];
+
+      if (! name_match (e->name) || excluded_name (e->name, NULL))
+	continue;
+      fputs (quotearg (e->name), stdlis);
+      if ((e->typeflag == DIRTYPE || e->typeflag == GNUTYPE_DUMPDIR)
+	  && ! ISSLASH (e->name[strlen (e->name) - 1]))
+	fputc ('/', stdlis);
+      fputc ('\n', stdlis);
+    }
+}
+
+/* Position the archive at the next member that may be wanted, according
+   to the index.  Return false if there are no such members left.  */
+bool
+index_seek_member (void)
+{
+  off_t offset;
+
+  if (! index_active)
+    return true;
+
+  offset = current_block_ordinal () * BLOCKSIZE;
+  while (index_next < index_count)
+    {
+      struct index_entry const *e = &index_table[index_next++];
+
+      if (e->header_offset < offset
+	  || ! (index_header_entry (e) || name_wanted_p (e->name)))
+	continue;
+
+      if (e->header_offset != offset)
+	{
+	  if (index_frames_active)
+	    index_seek_frame (e->header_offset);
+	  if (! seek_archive_block (e->header_offset / BLOCKSIZE))
+	    FATAL_ERROR ((0, 0, _("%s: Index does not match the archive"),
+			  quotearg_colon (index_name)));
+	}
+      /* A global header is read along with the header that follows
+	 it, which is not necessarily the next entry.  */
+      index_pending = e->typeflag == XGLTYPE ? NULL : e;
+      return true;
+    }
+  return false;
+}
+
+/* Check that the header just read, with status STATUS and describing
+   the member ST, matches the index.  Trailing slashes in the member
+   name are ignored.  */
+void
+index_check_member (enum read_header status, struct tar_stat_info const *st)
+{
+  struct index_entry const *e = index_pending;
+
+  if (! e)
+    return;
+  index_pending = NULL;
+  if (status == HEADER_SUCCESS)
+    {
+      size_t len = strlen (e->name);
+      if (strncmp (st->file_name, e->name, len) == 0)
+	{
+	  char const *p;
+	  for (p = st->file_name + len; ISSLASH (*p); p++)
+	    continue;
+	  if (! *p)
+	    return;
+	}
+    }
+  FATAL_ERROR ((0, 0, _("%s: Index does not match the archive"),
+		quotearg_colon (index_name)));
+}
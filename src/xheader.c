@@ -450,10 +450,12 @@ xheader_write_global (struct xheader *xhdr)
   if (xhdr->stk)
     {
       char *name;
+      off_t block_ordinal = current_block_ordinal ();
 
       xheader_finish (xhdr);
       name = xheader_ghdr_name ();
       xheader_write (XGLTYPE, name, start_time.tv_sec, xhdr);
+      index_add_header (XGLTYPE, name, block_ordinal);
       free (name);
     }
 }
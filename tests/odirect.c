@@ -0,0 +1,64 @@
+/* Test suite for GNU tar - O_DIRECT failure emulator.
+
+   Copyright 2016 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   Description:  a library to be preloaded into tar, which makes reads
+   and writes fail with EINVAL on descriptors that have O_DIRECT set,
+   as on file systems that accept the flag but not the transfers. */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static int
+direct_p (int fd)
+{
+  int flags = fcntl (fd, F_GETFL);
+  return 0 <= flags && (flags & O_DIRECT);
+}
+
+ssize_t
+read (int fd, void *buf, size_t size)
+{
+  static ssize_t (*real_read) (int, void *, size_t);
+
+  if (direct_p (fd))
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  if (!real_read)
+    real_read = (ssize_t (*) (int, void *, size_t)) dlsym (RTLD_NEXT, "read");
+  return real_read (fd, buf, size);
+}
+
+ssize_t
+write (int fd, void const *buf, size_t size)
+{
+  static ssize_t (*real_write) (int, void const *, size_t);
+
+  if (direct_p (fd))
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  if (!real_write)
+    real_write = (ssize_t (*) (int, void const *, size_t))
+      dlsym (RTLD_NEXT, "write");
+  return real_write (fd, buf, size);
+}